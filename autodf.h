@@ -19,8 +19,25 @@
 #ifndef AUTODF_H
 #define AUTODF_H
 
+#include <algorithm>
 #include <array>
 #include <cmath>
+#include <cstddef>
+#include <limits>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+// Children of expression nodes may share address with each other when they are empty (Variable, CConst),
+// so expressions built only from such nodes carry no data at all
+#if defined(__has_cpp_attribute)
+#if __has_cpp_attribute(no_unique_address)
+#define AUTODF_NO_UNIQUE_ADDRESS [[no_unique_address]]
+#endif
+#endif
+#ifndef AUTODF_NO_UNIQUE_ADDRESS
+#define AUTODF_NO_UNIQUE_ADDRESS
+#endif
 
 namespace autodf
 {
@@ -44,6 +61,18 @@ struct Sub;
 template <unsigned ID>
 struct Variable;
 
+// Forward declaration for BlockSum;
+template <typename T1, typename T2>
+struct BlockSum;
+
+// Forward declaration for BlockSub;
+template <typename T1, typename T2>
+struct BlockSub;
+
+// Forward declaration for BlockScale;
+template <typename T1, typename T2>
+struct BlockScale;
+
 #define CONST_OPS(TypeName)                                                           \
     constexpr Sum<const TypeName, const Const> operator+(const double value_in) const \
     {                                                                                 \
@@ -84,11 +113,28 @@ struct Variable;
         return Div<const TypeName, const TX>{*this, other};                 \
     }
 
+#define BLOCK_OPS(TypeName)                                                                  \
+    template <typename TX>                                                                   \
+    constexpr BlockSum<const TypeName, const TX> operator+(const TX other) const             \
+    {                                                                                        \
+        return BlockSum<const TypeName, const TX>{*this, other};                             \
+    }                                                                                        \
+    template <typename TX>                                                                   \
+    constexpr BlockSub<const TypeName, const TX> operator-(const TX other) const             \
+    {                                                                                        \
+        return BlockSub<const TypeName, const TX>{*this, other};                             \
+    }                                                                                        \
+    constexpr BlockScale<const Const, const TypeName> operator*(const double value_in) const \
+    {                                                                                        \
+        return BlockScale<const Const, const TypeName>{Const{value_in}, *this};              \
+    }
+
 ///////////////////////////////////////////////////////////////////////////////////////////////
 //! Constant
 struct Const
 {
     static constexpr unsigned MAXID = 0;
+    static constexpr unsigned DYNCOUNT = 0;
     explicit constexpr Const(const double v) : value(v) {}
     const double value;
 
@@ -104,6 +150,13 @@ struct Const
         return 0.0;
     }
 
+    template <unsigned AMNT = MAXID + 1, typename Sink>
+    constexpr void backward([[maybe_unused]] const std::array<double, AMNT>& unused,
+                            [[maybe_unused]] const double adjoint,
+                            [[maybe_unused]] Sink& sink) const
+    {
+    }
+
     // operations with other Const
     constexpr Const operator+(const Const other) const { return Const{value + other.value}; }
     constexpr Const operator-(const Const other) const { return Const{value - other.value}; }
@@ -139,12 +192,73 @@ constexpr Const operator/(const double a, const Const& b)
     return Const{a / b.value};
 }
 
+#if defined(__cpp_nontype_template_args) && __cpp_nontype_template_args >= 201911L
+///////////////////////////////////////////////////////////////////////////////////////////////
+//! Compile-time constant, value is part of the type, so the node is empty and gets folded into immediates.
+//! Requires C++20 floating-point template parameters.
+template <double V>
+struct CConst
+{
+    static constexpr unsigned MAXID = 0;
+    static constexpr unsigned DYNCOUNT = 0;
+    static constexpr double value = V;
+
+    template <unsigned AMNT = MAXID + 1>
+    [[nodiscard]] constexpr double eval([[maybe_unused]] const std::array<double, AMNT>& unused = {}) const
+    {
+        return V;
+    }
+
+    template <unsigned forID, unsigned AMNT = MAXID + 1>
+    [[nodiscard]] constexpr double gradient([[maybe_unused]] const std::array<double, AMNT>& unused) const
+    {
+        return 0.0;
+    }
+
+    template <unsigned AMNT = MAXID + 1, typename Sink>
+    constexpr void backward([[maybe_unused]] const std::array<double, AMNT>& unused,
+                            [[maybe_unused]] const double adjoint,
+                            [[maybe_unused]] Sink& sink) const
+    {
+    }
+
+    // operations with other CConst are resolved at compile time
+    template <double W>
+    constexpr CConst<V + W> operator+(const CConst<W>) const
+    {
+        return {};
+    }
+    template <double W>
+    constexpr CConst<V - W> operator-(const CConst<W>) const
+    {
+        return {};
+    }
+    template <double W>
+    constexpr CConst<V * W> operator*(const CConst<W>) const
+    {
+        return {};
+    }
+    template <double W>
+    constexpr CConst<V / W> operator/(const CConst<W>) const
+    {
+        return {};
+    }
+
+    CONST_OPS(CConst<V>)
+    GENERIC_OPS(CConst<V>)
+};
+
+template <double V>
+inline constexpr CConst<V> cconst{};
+#endif
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 //! Represents a variable, template parameter ID defines variable uniqueness
 template <unsigned ID = 0>
 struct Variable
 {
     static constexpr unsigned MAXID = ID;
+    static constexpr unsigned DYNCOUNT = 0;
 
     template <unsigned AMNT = MAXID + 1>
     [[nodiscard]] constexpr double eval(const std::array<double, AMNT>& input) const
@@ -158,6 +272,14 @@ struct Variable
         return forID == ID ? 1.0 : 0.0;
     }
 
+    template <unsigned AMNT = MAXID + 1, typename Sink>
+    constexpr void backward([[maybe_unused]] const std::array<double, AMNT>& input,
+                            const double adjoint,
+                            Sink& sink) const
+    {
+        sink.template variable<ID>(adjoint);
+    }
+
     CONST_OPS(Variable<ID>)
     GENERIC_OPS(Variable<ID>)
 };
@@ -185,9 +307,10 @@ template <typename T1, typename T2>
 struct Mul
 {
     static constexpr unsigned MAXID = T1::MAXID > T2::MAXID ? T1::MAXID : T2::MAXID;
+    static constexpr unsigned DYNCOUNT = T1::DYNCOUNT + T2::DYNCOUNT;
     constexpr Mul(const T1 ai, const T2 bi) : a(ai), b(bi) {}
-    const T1 a;
-    const T2 b;
+    AUTODF_NO_UNIQUE_ADDRESS const T1 a;
+    AUTODF_NO_UNIQUE_ADDRESS const T2 b;
 
     template <unsigned AMNT = MAXID + 1>
     [[nodiscard]] constexpr double eval(const std::array<double, AMNT>& input) const
@@ -202,6 +325,15 @@ struct Mul
                b.template gradient<forID, AMNT>(input) * a.template eval<AMNT>(input);
     }
 
+    template <unsigned AMNT = MAXID + 1, typename Sink>
+    constexpr void backward(const std::array<double, AMNT>& input, const double adjoint, Sink& sink) const
+    {
+        const double a_t = a.template eval<AMNT>(input);
+        const double b_t = b.template eval<AMNT>(input);
+        a.template backward<AMNT>(input, adjoint * b_t, sink);
+        b.template backward<AMNT>(input, adjoint * a_t, sink);
+    }
+
     using TypeName = Mul<T1, T2>;
     CONST_OPS(TypeName)
     GENERIC_OPS(TypeName)
@@ -219,9 +351,10 @@ template <typename T1, typename T2>
 struct Div
 {
     static constexpr unsigned MAXID = T1::MAXID > T2::MAXID ? T1::MAXID : T2::MAXID;
+    static constexpr unsigned DYNCOUNT = T1::DYNCOUNT + T2::DYNCOUNT;
     constexpr Div(const T1 ai, const T2 bi) : a(ai), b(bi) {}
-    const T1 a;
-    const T2 b;
+    AUTODF_NO_UNIQUE_ADDRESS const T1 a;
+    AUTODF_NO_UNIQUE_ADDRESS const T2 b;
 
     template <unsigned AMNT = MAXID + 1>
     [[nodiscard]] constexpr double eval(const std::array<double, AMNT>& input) const
@@ -237,6 +370,15 @@ struct Div
                (b.template eval<AMNT>(input) * b.template eval<AMNT>(input));
     }
 
+    template <unsigned AMNT = MAXID + 1, typename Sink>
+    constexpr void backward(const std::array<double, AMNT>& input, const double adjoint, Sink& sink) const
+    {
+        const double a_t = a.template eval<AMNT>(input);
+        const double b_t = b.template eval<AMNT>(input);
+        a.template backward<AMNT>(input, adjoint / b_t, sink);
+        b.template backward<AMNT>(input, -adjoint * a_t / (b_t * b_t), sink);
+    }
+
     using TypeName = Div<T1, T2>;
     CONST_OPS(TypeName)
     GENERIC_OPS(TypeName)
@@ -254,11 +396,12 @@ template <typename T1, typename T2>
 struct Sum
 {
     static constexpr unsigned MAXID = T1::MAXID > T2::MAXID ? T1::MAXID : T2::MAXID;
+    static constexpr unsigned DYNCOUNT = T1::DYNCOUNT + T2::DYNCOUNT;
 
     constexpr Sum(T1 ai, T2 bi) : a(ai), b(bi) {}
 
-    const T1 a;
-    const T2 b;
+    AUTODF_NO_UNIQUE_ADDRESS const T1 a;
+    AUTODF_NO_UNIQUE_ADDRESS const T2 b;
 
     template <unsigned AMNT = MAXID + 1>
     [[nodiscard]] constexpr double eval(const std::array<double, AMNT>& input) const
@@ -272,6 +415,13 @@ struct Sum
         return a.template gradient<forID, AMNT>(input) + b.template gradient<forID, AMNT>(input);
     }
 
+    template <unsigned AMNT = MAXID + 1, typename Sink>
+    constexpr void backward(const std::array<double, AMNT>& input, const double adjoint, Sink& sink) const
+    {
+        a.template backward<AMNT>(input, adjoint, sink);
+        b.template backward<AMNT>(input, adjoint, sink);
+    }
+
     using TypeName = Sum<T1, T2>;
     CONST_OPS(TypeName)
     GENERIC_OPS(TypeName)
@@ -290,11 +440,12 @@ template <typename T1, typename T2>
 struct Sub
 {
     static constexpr unsigned MAXID = T1::MAXID > T2::MAXID ? T1::MAXID : T2::MAXID;
+    static constexpr unsigned DYNCOUNT = T1::DYNCOUNT + T2::DYNCOUNT;
 
     constexpr Sub(const T1 ai, const T2 bi) : a(ai), b(bi) {}
 
-    const T1 a;
-    const T2 b;
+    AUTODF_NO_UNIQUE_ADDRESS const T1 a;
+    AUTODF_NO_UNIQUE_ADDRESS const T2 b;
 
     template <unsigned AMNT = MAXID + 1>
     [[nodiscard]] constexpr double eval(const std::array<double, AMNT>& input) const
@@ -308,6 +459,13 @@ struct Sub
         return a.template gradient<forID, AMNT>(input) - b.template gradient<forID, AMNT>(input);
     }
 
+    template <unsigned AMNT = MAXID + 1, typename Sink>
+    constexpr void backward(const std::array<double, AMNT>& input, const double adjoint, Sink& sink) const
+    {
+        a.template backward<AMNT>(input, adjoint, sink);
+        b.template backward<AMNT>(input, -adjoint, sink);
+    }
+
     using TypeName = Sub<T1, T2>;
     CONST_OPS(TypeName)
     GENERIC_OPS(TypeName)
@@ -326,16 +484,55 @@ constexpr Sub<const Const, const T1> operator-(const T1 a)
     return Sub<const Const, const T1>{Const{0.0}, a};
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//! Variable with runtime index, reads its value from an external parameter buffer.
+//! Could be freely mixed with compile-time Variable<ID> nodes, but does not take part in gradient<forID>(),
+//! use backward() with a sink (or sparseGradient() / scatterGradient()) to obtain its derivatives.
+struct DynamicVariable
+{
+    static constexpr unsigned MAXID = 0;
+    static constexpr unsigned DYNCOUNT = 1;
+
+    constexpr DynamicVariable(const double* buffer, const unsigned idx) : params(buffer), index(idx) {}
+
+    const double* const params;
+    const unsigned index;
+
+    template <unsigned AMNT = MAXID + 1>
+    [[nodiscard]] constexpr double eval([[maybe_unused]] const std::array<double, AMNT>& unused = {}) const
+    {
+        return params[index];
+    }
+
+    template <unsigned forID, unsigned AMNT = MAXID + 1>
+    [[nodiscard]] constexpr double gradient([[maybe_unused]] const std::array<double, AMNT>& unused) const
+    {
+        return 0.0;
+    }
+
+    template <unsigned AMNT = MAXID + 1, typename Sink>
+    constexpr void backward([[maybe_unused]] const std::array<double, AMNT>& unused,
+                            const double adjoint,
+                            Sink& sink) const
+    {
+        sink.parameter(index, adjoint);
+    }
+
+    CONST_OPS(DynamicVariable)
+    GENERIC_OPS(DynamicVariable)
+};
+
 ///////////////////////////////////////////////////////////////////////////////////////////////
 //! Sin() function
 template <typename T1>
 struct Sin
 {
     static constexpr unsigned MAXID = T1::MAXID;
+    static constexpr unsigned DYNCOUNT = T1::DYNCOUNT;
 
     explicit constexpr Sin(const T1 v) : value(v) {}
 
-    const T1 value;
+    AUTODF_NO_UNIQUE_ADDRESS const T1 value;
 
     template <unsigned AMNT = MAXID + 1>
     [[nodiscard]] constexpr double eval(const std::array<double, AMNT>& input = {}) const
@@ -349,6 +546,12 @@ struct Sin
         return value.template gradient<forID, AMNT>(input) * std::cos(value.template eval<AMNT>(input));
     }
 
+    template <unsigned AMNT = MAXID + 1, typename Sink>
+    constexpr void backward(const std::array<double, AMNT>& input, const double adjoint, Sink& sink) const
+    {
+        value.template backward<AMNT>(input, adjoint * std::cos(value.template eval<AMNT>(input)), sink);
+    }
+
     using TypeName = Sin<T1>;
     CONST_OPS(TypeName)
     GENERIC_OPS(TypeName)
@@ -365,10 +568,11 @@ template <typename T1>
 struct Asin
 {
     static constexpr unsigned MAXID = T1::MAXID;
+    static constexpr unsigned DYNCOUNT = T1::DYNCOUNT;
 
     explicit constexpr Asin(const T1 v) : value(v) {}
 
-    const T1 value;
+    AUTODF_NO_UNIQUE_ADDRESS const T1 value;
 
     template <unsigned AMNT = MAXID + 1>
     [[nodiscard]] constexpr double eval(const std::array<double, AMNT>& input = {}) const
@@ -383,6 +587,13 @@ struct Asin
                std::sqrt(1. - std::pow(value.template eval<AMNT>(input), 2.));
     }
 
+    template <unsigned AMNT = MAXID + 1, typename Sink>
+    constexpr void backward(const std::array<double, AMNT>& input, const double adjoint, Sink& sink) const
+    {
+        value.template backward<AMNT>(
+            input, adjoint / std::sqrt(1. - std::pow(value.template eval<AMNT>(input), 2.)), sink);
+    }
+
     using TypeName = Asin<T1>;
     CONST_OPS(TypeName)
     GENERIC_OPS(TypeName)
@@ -399,10 +610,11 @@ template <typename T1>
 struct Cos
 {
     static constexpr unsigned MAXID = T1::MAXID;
+    static constexpr unsigned DYNCOUNT = T1::DYNCOUNT;
 
     explicit constexpr Cos(const T1 v) : value(v) {}
 
-    const T1 value;
+    AUTODF_NO_UNIQUE_ADDRESS const T1 value;
 
     template <unsigned AMNT = MAXID + 1>
     [[nodiscard]] constexpr double eval(const std::array<double, AMNT>& input = {}) const
@@ -416,6 +628,12 @@ struct Cos
         return -value.template gradient<forID, AMNT>(input) * std::sin(value.template eval<AMNT>(input));
     }
 
+    template <unsigned AMNT = MAXID + 1, typename Sink>
+    constexpr void backward(const std::array<double, AMNT>& input, const double adjoint, Sink& sink) const
+    {
+        value.template backward<AMNT>(input, -adjoint * std::sin(value.template eval<AMNT>(input)), sink);
+    }
+
     using TypeName = Cos<T1>;
     CONST_OPS(TypeName)
     GENERIC_OPS(TypeName)
@@ -432,11 +650,12 @@ template <typename T1, typename T2>
 struct Atan2
 {
     static constexpr unsigned MAXID = T1::MAXID > T2::MAXID ? T1::MAXID : T2::MAXID;
+    static constexpr unsigned DYNCOUNT = T1::DYNCOUNT + T2::DYNCOUNT;
 
     constexpr Atan2(T1 yi, T2 xi) : a(yi), b(xi) {}
 
-    const T1 a;
-    const T2 b;
+    AUTODF_NO_UNIQUE_ADDRESS const T1 a;
+    AUTODF_NO_UNIQUE_ADDRESS const T2 b;
 
     template <unsigned AMNT = MAXID + 1>
     [[nodiscard]] constexpr double eval(const std::array<double, AMNT>& input) const
@@ -458,6 +677,16 @@ struct Atan2
         return datan2_a_t * da_dt + datan2_b_t * db_dt;
     }
 
+    template <unsigned AMNT = MAXID + 1, typename Sink>
+    constexpr void backward(const std::array<double, AMNT>& input, const double adjoint, Sink& sink) const
+    {
+        const auto b_t = b.template eval<AMNT>(input);
+        const auto a_t = a.template eval<AMNT>(input);
+        const auto norm2 = a_t * a_t + b_t * b_t;
+        a.template backward<AMNT>(input, adjoint * b_t / norm2, sink);
+        b.template backward<AMNT>(input, -adjoint * a_t / norm2, sink);
+    }
+
     using TypeName = Atan2<T1, T2>;
     CONST_OPS(TypeName)
     GENERIC_OPS(TypeName)
@@ -475,10 +704,11 @@ template <typename T1>
 struct Sqrt
 {
     static constexpr unsigned MAXID = T1::MAXID;
+    static constexpr unsigned DYNCOUNT = T1::DYNCOUNT;
 
     explicit constexpr Sqrt(const T1 v) : value(v) {}
 
-    const T1 value;
+    AUTODF_NO_UNIQUE_ADDRESS const T1 value;
 
     template <unsigned AMNT = MAXID + 1>
     [[nodiscard]] constexpr double eval(const std::array<double, AMNT>& input = {}) const
@@ -492,6 +722,12 @@ struct Sqrt
         return (0.5 / std::sqrt(value.template eval<AMNT>(input))) * value.template gradient<forID, AMNT>(input);
     }
 
+    template <unsigned AMNT = MAXID + 1, typename Sink>
+    constexpr void backward(const std::array<double, AMNT>& input, const double adjoint, Sink& sink) const
+    {
+        value.template backward<AMNT>(input, (0.5 / std::sqrt(value.template eval<AMNT>(input))) * adjoint, sink);
+    }
+
     using TypeName = Sqrt<T1>;
     CONST_OPS(TypeName)
     GENERIC_OPS(TypeName)
@@ -509,10 +745,11 @@ struct IfPositive
 {
     static constexpr unsigned MAXID = T1::MAXID > T2::MAXID ? ((T1::MAXID > T3::MAXID) ? T1::MAXID : T3::MAXID)
                                                             : ((T2::MAXID > T3::MAXID) ? T2::MAXID : T3::MAXID);
+    static constexpr unsigned DYNCOUNT = T1::DYNCOUNT + T2::DYNCOUNT + T3::DYNCOUNT;
 
-    const T1 condition;
-    const T2 valueIfTrue;
-    const T3 valueIfFalse;
+    AUTODF_NO_UNIQUE_ADDRESS const T1 condition;
+    AUTODF_NO_UNIQUE_ADDRESS const T2 valueIfTrue;
+    AUTODF_NO_UNIQUE_ADDRESS const T3 valueIfFalse;
 
     explicit constexpr IfPositive(const T1 eq, const T2 ifTrue, const T3 ifFalse)
         : condition(eq), valueIfTrue(ifTrue), valueIfFalse(ifFalse)
@@ -544,6 +781,19 @@ struct IfPositive
             return valueIfFalse.template gradient<forID, AMNT>(input);
         }
     }
+
+    template <unsigned AMNT = MAXID + 1, typename Sink>
+    constexpr void backward(const std::array<double, AMNT>& input, const double adjoint, Sink& sink) const
+    {
+        if (condition.template eval<AMNT>(input) > 0.0)
+        {
+            valueIfTrue.template backward<AMNT>(input, adjoint, sink);
+        }
+        else
+        {
+            valueIfFalse.template backward<AMNT>(input, adjoint, sink);
+        }
+    }
     using TypeName = IfPositive<T1, T2, T3>;
     CONST_OPS(TypeName)
     GENERIC_OPS(TypeName)
@@ -571,6 +821,1653 @@ constexpr double ifPositive(const double condition, const double ifTrue, const d
     return (condition > 0.0) ? ifTrue : ifFalse;
 }
 
+///////////////////////////////////////////////////////////////////////////////////////////////
+//! Block expressions: 3-vectors (SIZE 3), row-major 3x3 matrices (SIZE 9) and quaternions (SIZE 4, as w, x, y, z).
+//! eval() and gradient<forID>() return std::array<double, SIZE>, backward() takes an adjoint per element.
+//! Every block operation is a single node with derivatives defined for the whole block.
+
+//! Small fixed-size kernels used by block nodes
+struct BlockMath
+{
+    template <std::size_t N>
+    [[nodiscard]] static constexpr double dot(const std::array<double, N>& a, const std::array<double, N>& b)
+    {
+        double result = 0.0;
+        for (std::size_t i = 0; i < N; i++)
+        {
+            result += a[i] * b[i];
+        }
+        return result;
+    }
+
+    [[nodiscard]] static constexpr std::array<double, 3> cross(const std::array<double, 3>& a,
+                                                               const std::array<double, 3>& b)
+    {
+        return {a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0]};
+    }
+
+    [[nodiscard]] static constexpr std::array<double, 3> matVec(const std::array<double, 9>& m,
+                                                                const std::array<double, 3>& v)
+    {
+        return {m[0] * v[0] + m[1] * v[1] + m[2] * v[2],
+                m[3] * v[0] + m[4] * v[1] + m[5] * v[2],
+                m[6] * v[0] + m[7] * v[1] + m[8] * v[2]};
+    }
+
+    [[nodiscard]] static constexpr std::array<double, 3> matTVec(const std::array<double, 9>& m,
+                                                                 const std::array<double, 3>& v)
+    {
+        return {m[0] * v[0] + m[3] * v[1] + m[6] * v[2],
+                m[1] * v[0] + m[4] * v[1] + m[7] * v[2],
+                m[2] * v[0] + m[5] * v[1] + m[8] * v[2]};
+    }
+
+    [[nodiscard]] static constexpr std::array<double, 4> hamilton(const std::array<double, 4>& p,
+                                                                  const std::array<double, 4>& q)
+    {
+        return {p[0] * q[0] - p[1] * q[1] - p[2] * q[2] - p[3] * q[3],
+                p[0] * q[1] + q[0] * p[1] + p[2] * q[3] - p[3] * q[2],
+                p[0] * q[2] + q[0] * p[2] + p[3] * q[1] - p[1] * q[3],
+                p[0] * q[3] + q[0] * p[3] + p[1] * q[2] - p[2] * q[1]};
+    }
+
+    template <std::size_t N>
+    [[nodiscard]] static constexpr std::array<double, N> add(const std::array<double, N>& a,
+                                                             const std::array<double, N>& b)
+    {
+        std::array<double, N> result{};
+        for (std::size_t i = 0; i < N; i++)
+        {
+            result[i] = a[i] + b[i];
+        }
+        return result;
+    }
+
+    template <std::size_t N>
+    [[nodiscard]] static constexpr std::array<double, N> scale(const double s, const std::array<double, N>& a)
+    {
+        std::array<double, N> result{};
+        for (std::size_t i = 0; i < N; i++)
+        {
+            result[i] = s * a[i];
+        }
+        return result;
+    }
+};
+
+//! N consecutive variables FIRST, FIRST + 1, ..., FIRST + N - 1 seen as one block
+template <unsigned FIRST, unsigned N>
+struct BlockVariable
+{
+    static constexpr unsigned SIZE = N;
+    static constexpr unsigned MAXID = FIRST + N - 1;
+    static constexpr unsigned DYNCOUNT = 0;
+
+    template <unsigned AMNT = MAXID + 1>
+    [[nodiscard]] constexpr std::array<double, SIZE> eval(const std::array<double, AMNT>& input) const
+    {
+        std::array<double, SIZE> result{};
+        for (unsigned i = 0; i < SIZE; i++)
+        {
+            result[i] = input[FIRST + i];
+        }
+        return result;
+    }
+
+    template <unsigned forID, unsigned AMNT = MAXID + 1>
+    [[nodiscard]] constexpr std::array<double, SIZE> gradient(
+        [[maybe_unused]] const std::array<double, AMNT>& input) const
+    {
+        std::array<double, SIZE> result{};
+        if constexpr (forID >= FIRST && forID <= MAXID)
+        {
+            result[forID - FIRST] = 1.0;
+        }
+        return result;
+    }
+
+    template <unsigned AMNT = MAXID + 1, typename Sink>
+    constexpr void backward([[maybe_unused]] const std::array<double, AMNT>& input,
+                            const std::array<double, SIZE>& adjoint,
+                            Sink& sink) const
+    {
+        scatter(adjoint, sink, std::make_index_sequence<SIZE>{});
+    }
+
+    using TypeName = BlockVariable<FIRST, N>;
+    BLOCK_OPS(TypeName)
+
+  private:
+    template <typename Sink, std::size_t... I>
+    static constexpr void scatter(const std::array<double, SIZE>& adjoint, Sink& sink, std::index_sequence<I...>)
+    {
+        (sink.template variable<FIRST + I>(adjoint[I]), ...);
+    }
+};
+
+template <unsigned ID>
+using Vec3Variable = BlockVariable<ID, 3>;
+
+template <unsigned ID>
+using Mat3Variable = BlockVariable<ID, 9>;
+
+template <unsigned ID>
+using QuatVariable = BlockVariable<ID, 4>;
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//! Block of N constants
+template <unsigned N>
+struct BlockConst
+{
+    static constexpr unsigned SIZE = N;
+    static constexpr unsigned MAXID = 0;
+    static constexpr unsigned DYNCOUNT = 0;
+
+    explicit constexpr BlockConst(const std::array<double, N>& v) : values(v) {}
+
+    const std::array<double, N> values;
+
+    template <unsigned AMNT = MAXID + 1>
+    [[nodiscard]] constexpr std::array<double, SIZE> eval(
+        [[maybe_unused]] const std::array<double, AMNT>& unused = {}) const
+    {
+        return values;
+    }
+
+    template <unsigned forID, unsigned AMNT = MAXID + 1>
+    [[nodiscard]] constexpr std::array<double, SIZE> gradient(
+        [[maybe_unused]] const std::array<double, AMNT>& unused) const
+    {
+        return {};
+    }
+
+    template <unsigned AMNT = MAXID + 1, typename Sink>
+    constexpr void backward([[maybe_unused]] const std::array<double, AMNT>& unused,
+                            [[maybe_unused]] const std::array<double, SIZE>& adjoint,
+                            [[maybe_unused]] Sink& sink) const
+    {
+    }
+
+    using TypeName = BlockConst<N>;
+    BLOCK_OPS(TypeName)
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//! 3-vector assembled from three scalar expressions
+template <typename T1, typename T2, typename T3>
+struct Vec3
+{
+    static constexpr unsigned SIZE = 3;
+    static constexpr unsigned MAXID = T1::MAXID > T2::MAXID ? ((T1::MAXID > T3::MAXID) ? T1::MAXID : T3::MAXID)
+                                                            : ((T2::MAXID > T3::MAXID) ? T2::MAXID : T3::MAXID);
+    static constexpr unsigned DYNCOUNT = T1::DYNCOUNT + T2::DYNCOUNT + T3::DYNCOUNT;
+
+    constexpr Vec3(const T1 xi, const T2 yi, const T3 zi) : x(xi), y(yi), z(zi) {}
+
+    AUTODF_NO_UNIQUE_ADDRESS const T1 x;
+    AUTODF_NO_UNIQUE_ADDRESS const T2 y;
+    AUTODF_NO_UNIQUE_ADDRESS const T3 z;
+
+    template <unsigned AMNT = MAXID + 1>
+    [[nodiscard]] constexpr std::array<double, SIZE> eval(const std::array<double, AMNT>& input = {}) const
+    {
+        return {x.template eval<AMNT>(input), y.template eval<AMNT>(input), z.template eval<AMNT>(input)};
+    }
+
+    template <unsigned forID, unsigned AMNT = MAXID + 1>
+    [[nodiscard]] constexpr std::array<double, SIZE> gradient(const std::array<double, AMNT>& input) const
+    {
+        return {x.template gradient<forID, AMNT>(input),
+                y.template gradient<forID, AMNT>(input),
+                z.template gradient<forID, AMNT>(input)};
+    }
+
+    template <unsigned AMNT = MAXID + 1, typename Sink>
+    constexpr void backward(const std::array<double, AMNT>& input,
+                            const std::array<double, SIZE>& adjoint,
+                            Sink& sink) const
+    {
+        x.template backward<AMNT>(input, adjoint[0], sink);
+        y.template backward<AMNT>(input, adjoint[1], sink);
+        z.template backward<AMNT>(input, adjoint[2], sink);
+    }
+
+    using TypeName = Vec3<T1, T2, T3>;
+    BLOCK_OPS(TypeName)
+};
+template <typename T1, typename T2, typename T3>
+constexpr Vec3<const T1, const T2, const T3> vec3(const T1 x, const T2 y, const T3 z)
+{
+    return Vec3<const T1, const T2, const T3>{x, y, z};
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//! Element-wise summation of two blocks of the same size
+template <typename T1, typename T2>
+struct BlockSum
+{
+    static_assert(T1::SIZE == T2::SIZE, "BlockSum requires blocks of the same size");
+    static constexpr unsigned SIZE = T1::SIZE;
+    static constexpr unsigned MAXID = T1::MAXID > T2::MAXID ? T1::MAXID : T2::MAXID;
+    static constexpr unsigned DYNCOUNT = T1::DYNCOUNT + T2::DYNCOUNT;
+
+    constexpr BlockSum(const T1 ai, const T2 bi) : a(ai), b(bi) {}
+
+    AUTODF_NO_UNIQUE_ADDRESS const T1 a;
+    AUTODF_NO_UNIQUE_ADDRESS const T2 b;
+
+    template <unsigned AMNT = MAXID + 1>
+    [[nodiscard]] constexpr std::array<double, SIZE> eval(const std::array<double, AMNT>& input = {}) const
+    {
+        return BlockMath::add(a.template eval<AMNT>(input), b.template eval<AMNT>(input));
+    }
+
+    template <unsigned forID, unsigned AMNT = MAXID + 1>
+    [[nodiscard]] constexpr std::array<double, SIZE> gradient(const std::array<double, AMNT>& input) const
+    {
+        return BlockMath::add(a.template gradient<forID, AMNT>(input), b.template gradient<forID, AMNT>(input));
+    }
+
+    template <unsigned AMNT = MAXID + 1, typename Sink>
+    constexpr void backward(const std::array<double, AMNT>& input,
+                            const std::array<double, SIZE>& adjoint,
+                            Sink& sink) const
+    {
+        a.template backward<AMNT>(input, adjoint, sink);
+        b.template backward<AMNT>(input, adjoint, sink);
+    }
+
+    using TypeName = BlockSum<T1, T2>;
+    BLOCK_OPS(TypeName)
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//! Element-wise subtraction of two blocks of the same size
+template <typename T1, typename T2>
+struct BlockSub
+{
+    static_assert(T1::SIZE == T2::SIZE, "BlockSub requires blocks of the same size");
+    static constexpr unsigned SIZE = T1::SIZE;
+    static constexpr unsigned MAXID = T1::MAXID > T2::MAXID ? T1::MAXID : T2::MAXID;
+    static constexpr unsigned DYNCOUNT = T1::DYNCOUNT + T2::DYNCOUNT;
+
+    constexpr BlockSub(const T1 ai, const T2 bi) : a(ai), b(bi) {}
+
+    AUTODF_NO_UNIQUE_ADDRESS const T1 a;
+    AUTODF_NO_UNIQUE_ADDRESS const T2 b;
+
+    template <unsigned AMNT = MAXID + 1>
+    [[nodiscard]] constexpr std::array<double, SIZE> eval(const std::array<double, AMNT>& input = {}) const
+    {
+        return BlockMath::add(a.template eval<AMNT>(input), BlockMath::scale(-1.0, b.template eval<AMNT>(input)));
+    }
+
+    template <unsigned forID, unsigned AMNT = MAXID + 1>
+    [[nodiscard]] constexpr std::array<double, SIZE> gradient(const std::array<double, AMNT>& input) const
+    {
+        return BlockMath::add(a.template gradient<forID, AMNT>(input),
+                              BlockMath::scale(-1.0, b.template gradient<forID, AMNT>(input)));
+    }
+
+    template <unsigned AMNT = MAXID + 1, typename Sink>
+    constexpr void backward(const std::array<double, AMNT>& input,
+                            const std::array<double, SIZE>& adjoint,
+                            Sink& sink) const
+    {
+        a.template backward<AMNT>(input, adjoint, sink);
+        b.template backward<AMNT>(input, BlockMath::scale(-1.0, adjoint), sink);
+    }
+
+    using TypeName = BlockSub<T1, T2>;
+    BLOCK_OPS(TypeName)
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//! Block multiplied by a scalar expression
+template <typename T1, typename T2>
+struct BlockScale
+{
+    static constexpr unsigned SIZE = T2::SIZE;
+    static constexpr unsigned MAXID = T1::MAXID > T2::MAXID ? T1::MAXID : T2::MAXID;
+    static constexpr unsigned DYNCOUNT = T1::DYNCOUNT + T2::DYNCOUNT;
+
+    constexpr BlockScale(const T1 si, const T2 bi) : s(si), b(bi) {}
+
+    AUTODF_NO_UNIQUE_ADDRESS const T1 s;
+    AUTODF_NO_UNIQUE_ADDRESS const T2 b;
+
+    template <unsigned AMNT = MAXID + 1>
+    [[nodiscard]] constexpr std::array<double, SIZE> eval(const std::array<double, AMNT>& input = {}) const
+    {
+        return BlockMath::scale(s.template eval<AMNT>(input), b.template eval<AMNT>(input));
+    }
+
+    template <unsigned forID, unsigned AMNT = MAXID + 1>
+    [[nodiscard]] constexpr std::array<double, SIZE> gradient(const std::array<double, AMNT>& input) const
+    {
+        return BlockMath::add(
+            BlockMath::scale(s.template gradient<forID, AMNT>(input), b.template eval<AMNT>(input)),
+            BlockMath::scale(s.template eval<AMNT>(input), b.template gradient<forID, AMNT>(input)));
+    }
+
+    template <unsigned AMNT = MAXID + 1, typename Sink>
+    constexpr void backward(const std::array<double, AMNT>& input,
+                            const std::array<double, SIZE>& adjoint,
+                            Sink& sink) const
+    {
+        s.template backward<AMNT>(input, BlockMath::dot(adjoint, b.template eval<AMNT>(input)), sink);
+        b.template backward<AMNT>(input, BlockMath::scale(s.template eval<AMNT>(input), adjoint), sink);
+    }
+
+    using TypeName = BlockScale<T1, T2>;
+    BLOCK_OPS(TypeName)
+};
+template <typename T1, typename T2>
+constexpr BlockScale<const T1, const T2> scale(const T1 s, const T2 b)
+{
+    return BlockScale<const T1, const T2>{s, b};
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//! Cross product of two 3-vectors
+template <typename T1, typename T2>
+struct Cross
+{
+    static_assert(T1::SIZE == 3 && T2::SIZE == 3, "Cross requires two 3-vectors");
+    static constexpr unsigned SIZE = 3;
+    static constexpr unsigned MAXID = T1::MAXID > T2::MAXID ? T1::MAXID : T2::MAXID;
+    static constexpr unsigned DYNCOUNT = T1::DYNCOUNT + T2::DYNCOUNT;
+
+    constexpr Cross(const T1 ai, const T2 bi) : a(ai), b(bi) {}
+
+    AUTODF_NO_UNIQUE_ADDRESS const T1 a;
+    AUTODF_NO_UNIQUE_ADDRESS const T2 b;
+
+    template <unsigned AMNT = MAXID + 1>
+    [[nodiscard]] constexpr std::array<double, SIZE> eval(const std::array<double, AMNT>& input = {}) const
+    {
+        return BlockMath::cross(a.template eval<AMNT>(input), b.template eval<AMNT>(input));
+    }
+
+    template <unsigned forID, unsigned AMNT = MAXID + 1>
+    [[nodiscard]] constexpr std::array<double, SIZE> gradient(const std::array<double, AMNT>& input) const
+    {
+        return BlockMath::add(BlockMath::cross(a.template gradient<forID, AMNT>(input), b.template eval<AMNT>(input)),
+                              BlockMath::cross(a.template eval<AMNT>(input), b.template gradient<forID, AMNT>(input)));
+    }
+
+    template <unsigned AMNT = MAXID + 1, typename Sink>
+    constexpr void backward(const std::array<double, AMNT>& input,
+                            const std::array<double, SIZE>& adjoint,
+                            Sink& sink) const
+    {
+        // (da x b) . w = da . (b x w), (a x db) . w = db . (w x a)
+        a.template backward<AMNT>(input, BlockMath::cross(b.template eval<AMNT>(input), adjoint), sink);
+        b.template backward<AMNT>(input, BlockMath::cross(adjoint, a.template eval<AMNT>(input)), sink);
+    }
+
+    using TypeName = Cross<T1, T2>;
+    BLOCK_OPS(TypeName)
+};
+template <typename T1, typename T2>
+constexpr Cross<const T1, const T2> cross(const T1 a, const T2 b)
+{
+    return Cross<const T1, const T2>{a, b};
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//! Product of 3x3 matrix and 3-vector
+template <typename T1, typename T2>
+struct MatVec
+{
+    static_assert(T1::SIZE == 9 && T2::SIZE == 3, "MatVec requires 3x3 matrix and 3-vector");
+    static constexpr unsigned SIZE = 3;
+    static constexpr unsigned MAXID = T1::MAXID > T2::MAXID ? T1::MAXID : T2::MAXID;
+    static constexpr unsigned DYNCOUNT = T1::DYNCOUNT + T2::DYNCOUNT;
+
+    constexpr MatVec(const T1 mi, const T2 vi) : m(mi), v(vi) {}
+
+    AUTODF_NO_UNIQUE_ADDRESS const T1 m;
+    AUTODF_NO_UNIQUE_ADDRESS const T2 v;
+
+    template <unsigned AMNT = MAXID + 1>
+    [[nodiscard]] constexpr std::array<double, SIZE> eval(const std::array<double, AMNT>& input = {}) const
+    {
+        return BlockMath::matVec(m.template eval<AMNT>(input), v.template eval<AMNT>(input));
+    }
+
+    template <unsigned forID, unsigned AMNT = MAXID + 1>
+    [[nodiscard]] constexpr std::array<double, SIZE> gradient(const std::array<double, AMNT>& input) const
+    {
+        return BlockMath::add(BlockMath::matVec(m.template gradient<forID, AMNT>(input), v.template eval<AMNT>(input)),
+                              BlockMath::matVec(m.template eval<AMNT>(input), v.template gradient<forID, AMNT>(input)));
+    }
+
+    template <unsigned AMNT = MAXID + 1, typename Sink>
+    constexpr void backward(const std::array<double, AMNT>& input,
+                            const std::array<double, SIZE>& adjoint,
+                            Sink& sink) const
+    {
+        const auto v_t = v.template eval<AMNT>(input);
+        std::array<double, 9> m_adjoint{};
+        for (unsigned i = 0; i < 3; i++)
+        {
+            for (unsigned j = 0; j < 3; j++)
+            {
+                m_adjoint[i * 3 + j] = adjoint[i] * v_t[j];
+            }
+        }
+        m.template backward<AMNT>(input, m_adjoint, sink);
+        v.template backward<AMNT>(input, BlockMath::matTVec(m.template eval<AMNT>(input), adjoint), sink);
+    }
+
+    using TypeName = MatVec<T1, T2>;
+    BLOCK_OPS(TypeName)
+};
+template <typename T1, typename T2>
+constexpr MatVec<const T1, const T2> matVec(const T1 m, const T2 v)
+{
+    return MatVec<const T1, const T2>{m, v};
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//! 3x3 rotation matrix around one of the coordinate axes (0 - X, 1 - Y, 2 - Z) by scalar angle
+template <unsigned AXIS, typename T1>
+struct Rotation
+{
+    static_assert(AXIS < 3, "Rotation axis must be 0, 1 or 2");
+    static constexpr unsigned SIZE = 9;
+    static constexpr unsigned MAXID = T1::MAXID;
+    static constexpr unsigned DYNCOUNT = T1::DYNCOUNT;
+
+    explicit constexpr Rotation(const T1 v) : angle(v) {}
+
+    AUTODF_NO_UNIQUE_ADDRESS const T1 angle;
+
+    template <unsigned AMNT = MAXID + 1>
+    [[nodiscard]] constexpr std::array<double, SIZE> eval(const std::array<double, AMNT>& input = {}) const
+    {
+        const double a = angle.template eval<AMNT>(input);
+        return matrix(std::cos(a), std::sin(a), 1.0);
+    }
+
+    template <unsigned forID, unsigned AMNT = MAXID + 1>
+    [[nodiscard]] constexpr std::array<double, SIZE> gradient(const std::array<double, AMNT>& input) const
+    {
+        const double a = angle.template eval<AMNT>(input);
+        return BlockMath::scale(angle.template gradient<forID, AMNT>(input), matrix(-std::sin(a), std::cos(a), 0.0));
+    }
+
+    template <unsigned AMNT = MAXID + 1, typename Sink>
+    constexpr void backward(const std::array<double, AMNT>& input,
+                            const std::array<double, SIZE>& adjoint,
+                            Sink& sink) const
+    {
+        const double a = angle.template eval<AMNT>(input);
+        angle.template backward<AMNT>(
+            input, BlockMath::dot(adjoint, matrix(-std::sin(a), std::cos(a), 0.0)), sink);
+    }
+
+    using TypeName = Rotation<AXIS, T1>;
+    BLOCK_OPS(TypeName)
+
+  private:
+    //! rotation matrix layout, also gives its derivative when called with (-sin, cos, 0)
+    [[nodiscard]] static constexpr std::array<double, SIZE> matrix(const double c, const double s, const double one)
+    {
+        if constexpr (AXIS == 0)
+        {
+            return {one, 0.0, 0.0, 0.0, c, -s, 0.0, s, c};
+        }
+        else if constexpr (AXIS == 1)
+        {
+            return {c, 0.0, s, 0.0, one, 0.0, -s, 0.0, c};
+        }
+        else
+        {
+            return {c, -s, 0.0, s, c, 0.0, 0.0, 0.0, one};
+        }
+    }
+};
+template <unsigned AXIS, typename T1>
+constexpr Rotation<AXIS, const T1> rotation(const T1 angle)
+{
+    return Rotation<AXIS, const T1>{angle};
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//! Hamilton product of two quaternions
+template <typename T1, typename T2>
+struct Hamilton
+{
+    static_assert(T1::SIZE == 4 && T2::SIZE == 4, "Hamilton requires two quaternions");
+    static constexpr unsigned SIZE = 4;
+    static constexpr unsigned MAXID = T1::MAXID > T2::MAXID ? T1::MAXID : T2::MAXID;
+    static constexpr unsigned DYNCOUNT = T1::DYNCOUNT + T2::DYNCOUNT;
+
+    constexpr Hamilton(const T1 pi, const T2 qi) : p(pi), q(qi) {}
+
+    AUTODF_NO_UNIQUE_ADDRESS const T1 p;
+    AUTODF_NO_UNIQUE_ADDRESS const T2 q;
+
+    template <unsigned AMNT = MAXID + 1>
+    [[nodiscard]] constexpr std::array<double, SIZE> eval(const std::array<double, AMNT>& input = {}) const
+    {
+        return BlockMath::hamilton(p.template eval<AMNT>(input), q.template eval<AMNT>(input));
+    }
+
+    template <unsigned forID, unsigned AMNT = MAXID + 1>
+    [[nodiscard]] constexpr std::array<double, SIZE> gradient(const std::array<double, AMNT>& input) const
+    {
+        return BlockMath::add(
+            BlockMath::hamilton(p.template gradient<forID, AMNT>(input), q.template eval<AMNT>(input)),
+            BlockMath::hamilton(p.template eval<AMNT>(input), q.template gradient<forID, AMNT>(input)));
+    }
+
+    template <unsigned AMNT = MAXID + 1, typename Sink>
+    constexpr void backward(const std::array<double, AMNT>& input,
+                            const std::array<double, SIZE>& adjoint,
+                            Sink& sink) const
+    {
+        const auto p_t = p.template eval<AMNT>(input);
+        const auto q_t = q.template eval<AMNT>(input);
+        const std::array<double, 3> pv{p_t[1], p_t[2], p_t[3]};
+        const std::array<double, 3> qv{q_t[1], q_t[2], q_t[3]};
+        const std::array<double, 3> gv{adjoint[1], adjoint[2], adjoint[3]};
+
+        const auto qxg = BlockMath::cross(qv, gv);
+        const auto gxp = BlockMath::cross(gv, pv);
+        const std::array<double, SIZE> p_adjoint{adjoint[0] * q_t[0] + BlockMath::dot(gv, qv),
+                                                 -adjoint[0] * qv[0] + q_t[0] * gv[0] + qxg[0],
+                                                 -adjoint[0] * qv[1] + q_t[0] * gv[1] + qxg[1],
+                                                 -adjoint[0] * qv[2] + q_t[0] * gv[2] + qxg[2]};
+        const std::array<double, SIZE> q_adjoint{adjoint[0] * p_t[0] + BlockMath::dot(gv, pv),
+                                                 -adjoint[0] * pv[0] + p_t[0] * gv[0] + gxp[0],
+                                                 -adjoint[0] * pv[1] + p_t[0] * gv[1] + gxp[1],
+                                                 -adjoint[0] * pv[2] + p_t[0] * gv[2] + gxp[2]};
+        p.template backward<AMNT>(input, p_adjoint, sink);
+        q.template backward<AMNT>(input, q_adjoint, sink);
+    }
+
+    using TypeName = Hamilton<T1, T2>;
+    BLOCK_OPS(TypeName)
+};
+template <typename T1, typename T2>
+constexpr Hamilton<const T1, const T2> hamilton(const T1 p, const T2 q)
+{
+    return Hamilton<const T1, const T2>{p, q};
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//! Rotation of 3-vector by unit quaternion, v' = v + w * t + u x t, where t = 2 * u x v
+template <typename T1, typename T2>
+struct QuatRotate
+{
+    static_assert(T1::SIZE == 4 && T2::SIZE == 3, "QuatRotate requires quaternion and 3-vector");
+    static constexpr unsigned SIZE = 3;
+    static constexpr unsigned MAXID = T1::MAXID > T2::MAXID ? T1::MAXID : T2::MAXID;
+    static constexpr unsigned DYNCOUNT = T1::DYNCOUNT + T2::DYNCOUNT;
+
+    constexpr QuatRotate(const T1 qi, const T2 vi) : q(qi), v(vi) {}
+
+    AUTODF_NO_UNIQUE_ADDRESS const T1 q;
+    AUTODF_NO_UNIQUE_ADDRESS const T2 v;
+
+    template <unsigned AMNT = MAXID + 1>
+    [[nodiscard]] constexpr std::array<double, SIZE> eval(const std::array<double, AMNT>& input = {}) const
+    {
+        const auto q_t = q.template eval<AMNT>(input);
+        const auto v_t = v.template eval<AMNT>(input);
+        const std::array<double, 3> u{q_t[1], q_t[2], q_t[3]};
+        const auto t = BlockMath::scale(2.0, BlockMath::cross(u, v_t));
+        return BlockMath::add(BlockMath::add(v_t, BlockMath::scale(q_t[0], t)), BlockMath::cross(u, t));
+    }
+
+    template <unsigned forID, unsigned AMNT = MAXID + 1>
+    [[nodiscard]] constexpr std::array<double, SIZE> gradient(const std::array<double, AMNT>& input) const
+    {
+        const auto q_t = q.template eval<AMNT>(input);
+        const auto v_t = v.template eval<AMNT>(input);
+        const auto dq = q.template gradient<forID, AMNT>(input);
+        const auto dv = v.template gradient<forID, AMNT>(input);
+        const std::array<double, 3> u{q_t[1], q_t[2], q_t[3]};
+        const std::array<double, 3> du{dq[1], dq[2], dq[3]};
+
+        const auto t = BlockMath::scale(2.0, BlockMath::cross(u, v_t));
+        const auto dt = BlockMath::scale(2.0, BlockMath::add(BlockMath::cross(du, v_t), BlockMath::cross(u, dv)));
+        // dv + dw * t + w * dt + du x t + u x dt
+        auto result = BlockMath::add(dv, BlockMath::scale(dq[0], t));
+        result = BlockMath::add(result, BlockMath::scale(q_t[0], dt));
+        result = BlockMath::add(result, BlockMath::cross(du, t));
+        return BlockMath::add(result, BlockMath::cross(u, dt));
+    }
+
+    template <unsigned AMNT = MAXID + 1, typename Sink>
+    constexpr void backward(const std::array<double, AMNT>& input,
+                            const std::array<double, SIZE>& adjoint,
+                            Sink& sink) const
+    {
+        const auto q_t = q.template eval<AMNT>(input);
+        const auto v_t = v.template eval<AMNT>(input);
+        const std::array<double, 3> u{q_t[1], q_t[2], q_t[3]};
+        const auto t = BlockMath::scale(2.0, BlockMath::cross(u, v_t));
+
+        // adjoint of t, then t = 2 * u x v is propagated further to u and v
+        const auto t_adjoint = BlockMath::add(BlockMath::scale(q_t[0], adjoint), BlockMath::cross(adjoint, u));
+        const auto u_adjoint = BlockMath::add(BlockMath::cross(t, adjoint),
+                                              BlockMath::scale(2.0, BlockMath::cross(v_t, t_adjoint)));
+        const auto v_adjoint = BlockMath::add(adjoint, BlockMath::scale(2.0, BlockMath::cross(t_adjoint, u)));
+
+        q.template backward<AMNT>(
+            input, std::array<double, 4>{BlockMath::dot(adjoint, t), u_adjoint[0], u_adjoint[1], u_adjoint[2]}, sink);
+        v.template backward<AMNT>(input, v_adjoint, sink);
+    }
+
+    using TypeName = QuatRotate<T1, T2>;
+    BLOCK_OPS(TypeName)
+};
+template <typename T1, typename T2>
+constexpr QuatRotate<const T1, const T2> rotate(const T1 q, const T2 v)
+{
+    return QuatRotate<const T1, const T2>{q, v};
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//! Dot product of two blocks, result is a scalar expression
+template <typename T1, typename T2>
+struct Dot
+{
+    static_assert(T1::SIZE == T2::SIZE, "Dot requires blocks of the same size");
+    static constexpr unsigned MAXID = T1::MAXID > T2::MAXID ? T1::MAXID : T2::MAXID;
+    static constexpr unsigned DYNCOUNT = T1::DYNCOUNT + T2::DYNCOUNT;
+
+    constexpr Dot(const T1 ai, const T2 bi) : a(ai), b(bi) {}
+
+    AUTODF_NO_UNIQUE_ADDRESS const T1 a;
+    AUTODF_NO_UNIQUE_ADDRESS const T2 b;
+
+    template <unsigned AMNT = MAXID + 1>
+    [[nodiscard]] constexpr double eval(const std::array<double, AMNT>& input = {}) const
+    {
+        return BlockMath::dot(a.template eval<AMNT>(input), b.template eval<AMNT>(input));
+    }
+
+    template <unsigned forID, unsigned AMNT = MAXID + 1>
+    [[nodiscard]] constexpr double gradient(const std::array<double, AMNT>& input) const
+    {
+        return BlockMath::dot(a.template gradient<forID, AMNT>(input), b.template eval<AMNT>(input)) +
+               BlockMath::dot(a.template eval<AMNT>(input), b.template gradient<forID, AMNT>(input));
+    }
+
+    template <unsigned AMNT = MAXID + 1, typename Sink>
+    constexpr void backward(const std::array<double, AMNT>& input, const double adjoint, Sink& sink) const
+    {
+        a.template backward<AMNT>(input, BlockMath::scale(adjoint, b.template eval<AMNT>(input)), sink);
+        b.template backward<AMNT>(input, BlockMath::scale(adjoint, a.template eval<AMNT>(input)), sink);
+    }
+
+    using TypeName = Dot<T1, T2>;
+    CONST_OPS(TypeName)
+    GENERIC_OPS(TypeName)
+};
+template <typename T1, typename T2>
+constexpr Dot<const T1, const T2> dot(const T1 a, const T2 b)
+{
+    return Dot<const T1, const T2>{a, b};
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//! Euclidean norm of a block, result is a scalar expression
+template <typename T1>
+struct Norm
+{
+    static constexpr unsigned MAXID = T1::MAXID;
+    static constexpr unsigned DYNCOUNT = T1::DYNCOUNT;
+
+    explicit constexpr Norm(const T1 v) : value(v) {}
+
+    AUTODF_NO_UNIQUE_ADDRESS const T1 value;
+
+    template <unsigned AMNT = MAXID + 1>
+    [[nodiscard]] constexpr double eval(const std::array<double, AMNT>& input = {}) const
+    {
+        const auto v = value.template eval<AMNT>(input);
+        return std::sqrt(BlockMath::dot(v, v));
+    }
+
+    template <unsigned forID, unsigned AMNT = MAXID + 1>
+    [[nodiscard]] constexpr double gradient(const std::array<double, AMNT>& input) const
+    {
+        const auto v = value.template eval<AMNT>(input);
+        return BlockMath::dot(v, value.template gradient<forID, AMNT>(input)) / std::sqrt(BlockMath::dot(v, v));
+    }
+
+    template <unsigned AMNT = MAXID + 1, typename Sink>
+    constexpr void backward(const std::array<double, AMNT>& input, const double adjoint, Sink& sink) const
+    {
+        const auto v = value.template eval<AMNT>(input);
+        value.template backward<AMNT>(input, BlockMath::scale(adjoint / std::sqrt(BlockMath::dot(v, v)), v), sink);
+    }
+
+    using TypeName = Norm<T1>;
+    CONST_OPS(TypeName)
+    GENERIC_OPS(TypeName)
+};
+template <typename T1>
+constexpr Norm<const T1> norm(const T1 a)
+{
+    return Norm<const T1>{a};
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//! Single element of a block, result is a scalar expression
+template <unsigned I, typename T1>
+struct Component
+{
+    static_assert(I < T1::SIZE, "Component index is out of block size");
+    static constexpr unsigned MAXID = T1::MAXID;
+    static constexpr unsigned DYNCOUNT = T1::DYNCOUNT;
+
+    explicit constexpr Component(const T1 v) : value(v) {}
+
+    AUTODF_NO_UNIQUE_ADDRESS const T1 value;
+
+    template <unsigned AMNT = MAXID + 1>
+    [[nodiscard]] constexpr double eval(const std::array<double, AMNT>& input = {}) const
+    {
+        return value.template eval<AMNT>(input)[I];
+    }
+
+    template <unsigned forID, unsigned AMNT = MAXID + 1>
+    [[nodiscard]] constexpr double gradient(const std::array<double, AMNT>& input) const
+    {
+        return value.template gradient<forID, AMNT>(input)[I];
+    }
+
+    template <unsigned AMNT = MAXID + 1, typename Sink>
+    constexpr void backward(const std::array<double, AMNT>& input, const double adjoint, Sink& sink) const
+    {
+        std::array<double, T1::SIZE> block_adjoint{};
+        block_adjoint[I] = adjoint;
+        value.template backward<AMNT>(input, block_adjoint, sink);
+    }
+
+    using TypeName = Component<I, T1>;
+    CONST_OPS(TypeName)
+    GENERIC_OPS(TypeName)
+};
+template <unsigned I, typename T1>
+constexpr Component<I, const T1> component(const T1 a)
+{
+    return Component<I, const T1>{a};
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//! Polynomial evaluation schemes, coefficients are in ascending order c[0] + c[1] * x + ... + c[N - 1] * x^(N - 1)
+struct PolynomialMath
+{
+    //! Horner scheme, N - 1 multiply-adds in a single dependency chain
+    template <std::size_t N>
+    [[nodiscard]] static constexpr double horner(const std::array<double, N>& c, const double x)
+    {
+        double p = c[N - 1];
+        for (std::size_t k = N - 1; k > 0; k--)
+        {
+            p = p * x + c[k - 1];
+        }
+        return p;
+    }
+
+    //! Horner scheme for value and first derivative in the same pass, {p(x), p'(x)}
+    template <std::size_t N>
+    [[nodiscard]] static constexpr std::array<double, 2> hornerWithDerivative(const std::array<double, N>& c,
+                                                                              const double x)
+    {
+        double p = c[N - 1];
+        double dp = 0.0;
+        for (std::size_t k = N - 1; k > 0; k--)
+        {
+            dp = dp * x + p;
+            p = p * x + c[k - 1];
+        }
+        return {p, dp};
+    }
+
+    //! Estrin scheme, pairs of terms are combined with x, x^2, x^4, ..., so independent multiply-adds
+    //! are exposed to the CPU pipeline and vectorizer
+    template <std::size_t N>
+    [[nodiscard]] static constexpr double estrin(const std::array<double, N>& c, const double x)
+    {
+        std::array<double, N> b = c;
+        std::size_t count = N;
+        double power = x;
+        while (count > 1)
+        {
+            for (std::size_t i = 0; i < count / 2; i++)
+            {
+                b[i] = b[2 * i] + b[2 * i + 1] * power;
+            }
+            if (count % 2 == 1)
+            {
+                b[count / 2] = b[count - 1];
+            }
+            count = (count + 1) / 2;
+            power *= power;
+        }
+        return b[0];
+    }
+
+    //! Number of arguments evaluated side by side in batched Estrin
+    static constexpr std::size_t LANES = 8;
+
+    template <std::size_t N>
+    using Lanes = std::array<std::array<double, LANES>, N>;
+
+    //! Estrin scheme over LANES arguments at once, c[k][l] is k-th coefficient for l-th argument.
+    //! Per-lane powers x, x^2, x^4, ... are computed once per level and the same reduction tree
+    //! runs over all lanes, so inner loops are independent multiply-adds the vectorizer can pack.
+    template <std::size_t N>
+    static void estrinLanes(const Lanes<N>& c, const std::array<double, LANES>& x, std::array<double, LANES>& out)
+    {
+        Lanes<(N + 1) / 2> b{};
+        std::array<double, LANES> power = x;
+        for (std::size_t i = 0; i < N / 2; i++)
+        {
+            for (std::size_t l = 0; l < LANES; l++)
+            {
+                b[i][l] = c[2 * i][l] + c[2 * i + 1][l] * power[l];
+            }
+        }
+        if constexpr (N % 2 == 1)
+        {
+            b[N / 2] = c[N - 1];
+        }
+        std::size_t count = (N + 1) / 2;
+        while (count > 1)
+        {
+            for (std::size_t l = 0; l < LANES; l++)
+            {
+                power[l] *= power[l];
+            }
+            for (std::size_t i = 0; i < count / 2; i++)
+            {
+                for (std::size_t l = 0; l < LANES; l++)
+                {
+                    b[i][l] = b[2 * i][l] + b[2 * i + 1][l] * power[l];
+                }
+            }
+            if (count % 2 == 1)
+            {
+                b[count / 2] = b[count - 1];
+            }
+            count = (count + 1) / 2;
+        }
+        out = b[0];
+    }
+
+    //! Estrin scheme over a batch of arguments, out[i] = p(x[i]).
+    //! Coefficients are broadcast to lanes once, the tail is padded with zero arguments.
+    template <std::size_t N>
+    static void estrinBatch(const std::array<double, N>& c, const double* x, double* out, const std::size_t n)
+    {
+        Lanes<N> lanes{};
+        for (std::size_t k = 0; k < N; k++)
+        {
+            lanes[k].fill(c[k]);
+        }
+        std::array<double, LANES> xs{};
+        std::array<double, LANES> ps{};
+        for (std::size_t i = 0; i < n; i += LANES)
+        {
+            const std::size_t m = std::min(LANES, n - i);
+            xs.fill(0.0);
+            std::copy(x + i, x + i + m, xs.begin());
+            estrinLanes(lanes, xs, ps);
+            std::copy(ps.begin(), ps.begin() + m, out + i);
+        }
+    }
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//! Polynomial of scalar expression, coefficients come from a block expression in ascending order.
+//! BlockConst gives fixed coefficients, BlockVariable makes coefficients differentiable parameters.
+template <typename T1, typename T2>
+struct Polynomial
+{
+    static constexpr unsigned SIZE = T2::SIZE;
+    static constexpr unsigned MAXID = T1::MAXID > T2::MAXID ? T1::MAXID : T2::MAXID;
+    static constexpr unsigned DYNCOUNT = T1::DYNCOUNT + T2::DYNCOUNT;
+    static constexpr bool CONST_COEFFICIENTS = std::is_same_v<std::remove_const_t<T2>, BlockConst<SIZE>>;
+
+    constexpr Polynomial(const T1 x, const T2 c) : value(x), coefficients(c) {}
+
+    AUTODF_NO_UNIQUE_ADDRESS const T1 value;
+    AUTODF_NO_UNIQUE_ADDRESS const T2 coefficients;
+
+    template <unsigned AMNT = MAXID + 1>
+    [[nodiscard]] constexpr double eval(const std::array<double, AMNT>& input = {}) const
+    {
+        return PolynomialMath::horner(coefficients.template eval<AMNT>(input), value.template eval<AMNT>(input));
+    }
+
+    //! Value and derivative w.r.t. polynomial argument in the same Horner pass, {p(x), p'(x)}
+    template <unsigned AMNT = MAXID + 1>
+    [[nodiscard]] constexpr std::array<double, 2> evalWithDerivative(const std::array<double, AMNT>& input = {}) const
+    {
+        return PolynomialMath::hornerWithDerivative(coefficients.template eval<AMNT>(input),
+                                                    value.template eval<AMNT>(input));
+    }
+
+    template <unsigned forID, unsigned AMNT = MAXID + 1>
+    [[nodiscard]] constexpr double gradient(const std::array<double, AMNT>& input) const
+    {
+        const double x = value.template eval<AMNT>(input);
+        const auto p = PolynomialMath::hornerWithDerivative(coefficients.template eval<AMNT>(input), x);
+        if constexpr (CONST_COEFFICIENTS)
+        {
+            return p[1] * value.template gradient<forID, AMNT>(input);
+        }
+        else
+        {
+            // coefficient derivatives are plugged in as coefficients of the same polynomial
+            return p[1] * value.template gradient<forID, AMNT>(input) +
+                   PolynomialMath::horner(coefficients.template gradient<forID, AMNT>(input), x);
+        }
+    }
+
+    template <unsigned AMNT = MAXID + 1, typename Sink>
+    constexpr void backward(const std::array<double, AMNT>& input, const double adjoint, Sink& sink) const
+    {
+        const double x = value.template eval<AMNT>(input);
+        const auto p = PolynomialMath::hornerWithDerivative(coefficients.template eval<AMNT>(input), x);
+        value.template backward<AMNT>(input, adjoint * p[1], sink);
+        if constexpr (!CONST_COEFFICIENTS)
+        {
+            std::array<double, SIZE> powers{};
+            double power = adjoint;
+            for (unsigned k = 0; k < SIZE; k++)
+            {
+                powers[k] = power;
+                power *= x;
+            }
+            coefficients.template backward<AMNT>(input, powers, sink);
+        }
+    }
+
+    //! Evaluates polynomial over a batch of inputs, out[i] = eval(inputs[i]), using lane-wise Estrin scheme.
+    //! Constant coefficients are evaluated and broadcast once for the whole batch.
+    template <unsigned AMNT = MAXID + 1>
+    void evalBatch(const std::array<double, AMNT>* inputs, double* out, const std::size_t n) const
+    {
+        constexpr std::size_t LANES = PolynomialMath::LANES;
+        PolynomialMath::Lanes<SIZE> lanes{};
+        if constexpr (CONST_COEFFICIENTS)
+        {
+            if (n == 0)
+            {
+                return;
+            }
+            const auto c = coefficients.template eval<AMNT>(inputs[0]);
+            for (unsigned k = 0; k < SIZE; k++)
+            {
+                lanes[k].fill(c[k]);
+            }
+        }
+        std::array<double, LANES> xs{};
+        std::array<double, LANES> ps{};
+        for (std::size_t i = 0; i < n; i += LANES)
+        {
+            const std::size_t m = std::min(LANES, n - i);
+            xs.fill(0.0);
+            for (std::size_t l = 0; l < m; l++)
+            {
+                xs[l] = value.template eval<AMNT>(inputs[i + l]);
+                if constexpr (!CONST_COEFFICIENTS)
+                {
+                    const auto c = coefficients.template eval<AMNT>(inputs[i + l]);
+                    for (unsigned k = 0; k < SIZE; k++)
+                    {
+                        lanes[k][l] = c[k];
+                    }
+                }
+            }
+            PolynomialMath::estrinLanes(lanes, xs, ps);
+            std::copy(ps.begin(), ps.begin() + m, out + i);
+        }
+    }
+
+    using TypeName = Polynomial<T1, T2>;
+    CONST_OPS(TypeName)
+    GENERIC_OPS(TypeName)
+};
+template <typename T1, std::size_t N>
+constexpr Polynomial<const T1, const BlockConst<N>> polynomial(const T1 x, const std::array<double, N>& coefficients)
+{
+    return Polynomial<const T1, const BlockConst<N>>{x, BlockConst<N>{coefficients}};
+}
+
+template <typename T1, typename T2>
+constexpr Polynomial<const T1, const T2> polynomial(const T1 x, const T2 coefficients)
+{
+    return Polynomial<const T1, const T2>{x, coefficients};
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//! Cubic Hermite basis on t in [0, 1]: {h00, h10, h01, h11} and their derivatives w.r.t. t
+struct HermiteBasis
+{
+    [[nodiscard]] static constexpr std::array<double, 4> value(const double t)
+    {
+        const double t2 = t * t;
+        const double t3 = t2 * t;
+        return {2.0 * t3 - 3.0 * t2 + 1.0, t3 - 2.0 * t2 + t, -2.0 * t3 + 3.0 * t2, t3 - t2};
+    }
+
+    [[nodiscard]] static constexpr std::array<double, 4> derivative(const double t)
+    {
+        const double t2 = t * t;
+        return {6.0 * t2 - 6.0 * t, 3.0 * t2 - 4.0 * t + 1.0, -6.0 * t2 + 6.0 * t, 3.0 * t2 - 2.0 * t};
+    }
+};
+
+//! Position on a uniform grid: cell index and local coordinate in [0, 1], arguments outside of range are clamped
+//! and flagged, so interpolants are constant there and report zero derivative along that axis
+struct GridCell
+{
+    unsigned index;
+    double t;
+    bool clamped;
+
+    [[nodiscard]] static constexpr GridCell locate(const double x, const double lo, const double step, const unsigned n)
+    {
+        const double pos = (x - lo) / step;
+        if (!(pos > 0.0))
+        {
+            return {0, 0.0, !(pos >= 0.0)};
+        }
+        if (pos >= static_cast<double>(n - 1))
+        {
+            return {n - 2, 1.0, pos > static_cast<double>(n - 1)};
+        }
+        const auto index = static_cast<unsigned>(pos);
+        return {index, pos - static_cast<double>(index), false};
+    }
+};
+
+// Forward declaration for Lookup1D;
+template <unsigned N, typename T1>
+struct Lookup1D;
+
+// Forward declaration for Lookup2D;
+template <unsigned NX, unsigned NY, typename T1, typename T2>
+struct Lookup2D;
+
+//! Values and slopes of 1-D expression on N uniform samples over [lo, hi]
+template <unsigned N>
+struct Table1D
+{
+    static_assert(N >= 2, "Table needs at least 2 samples");
+
+    double lo;
+    double hi;
+    double step;
+    std::array<double, N> values;
+    std::array<double, N> slopes;
+
+    //! Piecewise-linear interpolation
+    [[nodiscard]] constexpr double linear(const double x) const
+    {
+        const auto cell = GridCell::locate(x, lo, step, N);
+        return values[cell.index] + cell.t * (values[cell.index + 1] - values[cell.index]);
+    }
+
+    //! Cubic Hermite interpolation, uses tabulated gradients as slopes
+    [[nodiscard]] constexpr double hermite(const double x) const { return hermiteWithDerivative(x)[0]; }
+
+    //! Cubic Hermite interpolation together with its derivative, {f(x), f'(x)}, f'(x) is zero outside of [lo, hi]
+    [[nodiscard]] constexpr std::array<double, 2> hermiteWithDerivative(const double x) const
+    {
+        const auto cell = GridCell::locate(x, lo, step, N);
+        const auto h = HermiteBasis::value(cell.t);
+        const auto dh = HermiteBasis::derivative(cell.t);
+        const unsigned i = cell.index;
+        const double f =
+            h[0] * values[i] + h[1] * step * slopes[i] + h[2] * values[i + 1] + h[3] * step * slopes[i + 1];
+        if (cell.clamped)
+        {
+            return {f, 0.0};
+        }
+        const double df = (dh[0] * values[i] + dh[1] * step * slopes[i] + dh[2] * values[i + 1] +
+                           dh[3] * step * slopes[i + 1]) /
+                          step;
+        return {f, df};
+    }
+
+    //! Table lookup as an expression node, the table must outlive the node
+    template <typename T1>
+    [[nodiscard]] constexpr Lookup1D<N, const T1> at(const T1 x) const
+    {
+        return Lookup1D<N, const T1>{this, x};
+    }
+};
+
+//! Values and gradients of 2-D expression on NX x NY uniform samples over [lo, hi] box, stored row-major (y-major)
+template <unsigned NX, unsigned NY>
+struct Table2D
+{
+    static_assert(NX >= 2 && NY >= 2, "Table needs at least 2 samples per axis");
+
+    std::array<double, 2> lo;
+    std::array<double, 2> hi;
+    std::array<double, 2> step;
+    std::array<double, NX * NY> values;
+    std::array<double, NX * NY> dx;
+    std::array<double, NX * NY> dy;
+    //! cross derivative d2f/dxdy, estimated by finite differences of tabulated dx along y
+    std::array<double, NX * NY> dxy;
+
+    //! Bilinear interpolation
+    [[nodiscard]] constexpr double linear(const double x, const double y) const
+    {
+        const auto cx = GridCell::locate(x, lo[0], step[0], NX);
+        const auto cy = GridCell::locate(y, lo[1], step[1], NY);
+        const unsigned i = cy.index * NX + cx.index;
+        const double bottom = values[i] + cx.t * (values[i + 1] - values[i]);
+        const double top = values[i + NX] + cx.t * (values[i + NX + 1] - values[i + NX]);
+        return bottom + cy.t * (top - bottom);
+    }
+
+    //! Bicubic Hermite interpolation
+    [[nodiscard]] constexpr double hermite(const double x, const double y) const
+    {
+        return hermiteWithGradient(x, y)[0];
+    }
+
+    //! Bicubic Hermite interpolation together with its gradient, {f, df/dx, df/dy},
+    //! partial derivative along an axis is zero when that argument is outside of [lo, hi]
+    [[nodiscard]] constexpr std::array<double, 3> hermiteWithGradient(const double x, const double y) const
+    {
+        const auto cx = GridCell::locate(x, lo[0], step[0], NX);
+        const auto cy = GridCell::locate(y, lo[1], step[1], NY);
+        const auto hx = HermiteBasis::value(cx.t);
+        const auto hy = HermiteBasis::value(cy.t);
+        const auto dhx = HermiteBasis::derivative(cx.t);
+        const auto dhy = HermiteBasis::derivative(cy.t);
+
+        std::array<double, 3> result{};
+        for (unsigned b = 0; b < 2; b++)
+        {
+            for (unsigned a = 0; a < 2; a++)
+            {
+                const unsigned i = (cy.index + b) * NX + cx.index + a;
+                // basis for value is h[2 * a] (h00 or h01), for slope h[2 * a + 1] (h10 or h11)
+                const std::array<double, 4> corner{
+                    values[i], step[0] * dx[i], step[1] * dy[i], step[0] * step[1] * dxy[i]};
+                result[0] += hx[2 * a] * hy[2 * b] * corner[0] + hx[2 * a + 1] * hy[2 * b] * corner[1] +
+                             hx[2 * a] * hy[2 * b + 1] * corner[2] + hx[2 * a + 1] * hy[2 * b + 1] * corner[3];
+                result[1] += dhx[2 * a] * hy[2 * b] * corner[0] + dhx[2 * a + 1] * hy[2 * b] * corner[1] +
+                             dhx[2 * a] * hy[2 * b + 1] * corner[2] + dhx[2 * a + 1] * hy[2 * b + 1] * corner[3];
+                result[2] += hx[2 * a] * dhy[2 * b] * corner[0] + hx[2 * a + 1] * dhy[2 * b] * corner[1] +
+                             hx[2 * a] * dhy[2 * b + 1] * corner[2] + hx[2 * a + 1] * dhy[2 * b + 1] * corner[3];
+            }
+        }
+        result[1] = cx.clamped ? 0.0 : result[1] / step[0];
+        result[2] = cy.clamped ? 0.0 : result[2] / step[1];
+        return result;
+    }
+
+    //! Table lookup as an expression node, the table must outlive the node
+    template <typename T1, typename T2>
+    [[nodiscard]] constexpr Lookup2D<NX, NY, const T1, const T2> at(const T1 x, const T2 y) const
+    {
+        return Lookup2D<NX, NY, const T1, const T2>{this, x, y};
+    }
+};
+
+//! Samples 1-D expression of Variable<0> and its derivative on N uniform points over [lo, hi]
+template <unsigned N, typename T>
+[[nodiscard]] constexpr Table1D<N> tabulate(const T& expr, const double lo, const double hi)
+{
+    static_assert(T::MAXID == 0, "1-D tabulation requires expression of Variable<0> only");
+    Table1D<N> table{lo, hi, (hi - lo) / (N - 1), {}, {}};
+    for (unsigned i = 0; i < N; i++)
+    {
+        const std::array<double, 1> x{i + 1 == N ? hi : lo + i * table.step};
+        table.values[i] = expr.template eval<1>(x);
+        table.slopes[i] = expr.template gradient<0, 1>(x);
+    }
+    return table;
+}
+
+//! Samples 2-D expression of Variable<0> (x) and Variable<1> (y) and its gradient on NX x NY uniform grid
+template <unsigned NX, unsigned NY, typename T>
+[[nodiscard]] constexpr Table2D<NX, NY> tabulate(const T& expr,
+                                                 const std::array<double, 2> lo,
+                                                 const std::array<double, 2> hi)
+{
+    static_assert(T::MAXID <= 1, "2-D tabulation requires expression of Variable<0> and Variable<1> only");
+    Table2D<NX, NY> table{lo, hi, {(hi[0] - lo[0]) / (NX - 1), (hi[1] - lo[1]) / (NY - 1)}, {}, {}, {}, {}};
+    for (unsigned j = 0; j < NY; j++)
+    {
+        for (unsigned i = 0; i < NX; i++)
+        {
+            const std::array<double, 2> xy{i + 1 == NX ? hi[0] : lo[0] + i * table.step[0],
+                                           j + 1 == NY ? hi[1] : lo[1] + j * table.step[1]};
+            table.values[j * NX + i] = expr.template eval<2>(xy);
+            table.dx[j * NX + i] = expr.template gradient<0, 2>(xy);
+            table.dy[j * NX + i] = expr.template gradient<1, 2>(xy);
+        }
+    }
+    for (unsigned j = 0; j < NY; j++)
+    {
+        const unsigned prev = j == 0 ? 0 : j - 1;
+        const unsigned next = j + 1 == NY ? j : j + 1;
+        for (unsigned i = 0; i < NX; i++)
+        {
+            table.dxy[j * NX + i] =
+                (table.dx[next * NX + i] - table.dx[prev * NX + i]) / ((next - prev) * table.step[1]);
+        }
+    }
+    return table;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//! Cubic Hermite lookup into 1-D table, derivative comes from the interpolant and is zero outside of table range
+template <unsigned N, typename T1>
+struct Lookup1D
+{
+    static constexpr unsigned MAXID = T1::MAXID;
+    static constexpr unsigned DYNCOUNT = T1::DYNCOUNT;
+
+    constexpr Lookup1D(const Table1D<N>* t, const T1 v) : table(t), value(v) {}
+
+    const Table1D<N>* const table;
+    AUTODF_NO_UNIQUE_ADDRESS const T1 value;
+
+    template <unsigned AMNT = MAXID + 1>
+    [[nodiscard]] constexpr double eval(const std::array<double, AMNT>& input = {}) const
+    {
+        return table->hermite(value.template eval<AMNT>(input));
+    }
+
+    template <unsigned forID, unsigned AMNT = MAXID + 1>
+    [[nodiscard]] constexpr double gradient(const std::array<double, AMNT>& input) const
+    {
+        return table->hermiteWithDerivative(value.template eval<AMNT>(input))[1] *
+               value.template gradient<forID, AMNT>(input);
+    }
+
+    template <unsigned AMNT = MAXID + 1, typename Sink>
+    constexpr void backward(const std::array<double, AMNT>& input, const double adjoint, Sink& sink) const
+    {
+        value.template backward<AMNT>(
+            input, adjoint * table->hermiteWithDerivative(value.template eval<AMNT>(input))[1], sink);
+    }
+
+    using TypeName = Lookup1D<N, T1>;
+    CONST_OPS(TypeName)
+    GENERIC_OPS(TypeName)
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//! Bicubic Hermite lookup into 2-D table
+template <unsigned NX, unsigned NY, typename T1, typename T2>
+struct Lookup2D
+{
+    static constexpr unsigned MAXID = T1::MAXID > T2::MAXID ? T1::MAXID : T2::MAXID;
+    static constexpr unsigned DYNCOUNT = T1::DYNCOUNT + T2::DYNCOUNT;
+
+    constexpr Lookup2D(const Table2D<NX, NY>* t, const T1 xi, const T2 yi) : table(t), x(xi), y(yi) {}
+
+    const Table2D<NX, NY>* const table;
+    AUTODF_NO_UNIQUE_ADDRESS const T1 x;
+    AUTODF_NO_UNIQUE_ADDRESS const T2 y;
+
+    template <unsigned AMNT = MAXID + 1>
+    [[nodiscard]] constexpr double eval(const std::array<double, AMNT>& input = {}) const
+    {
+        return table->hermite(x.template eval<AMNT>(input), y.template eval<AMNT>(input));
+    }
+
+    template <unsigned forID, unsigned AMNT = MAXID + 1>
+    [[nodiscard]] constexpr double gradient(const std::array<double, AMNT>& input) const
+    {
+        const auto f = table->hermiteWithGradient(x.template eval<AMNT>(input), y.template eval<AMNT>(input));
+        return f[1] * x.template gradient<forID, AMNT>(input) + f[2] * y.template gradient<forID, AMNT>(input);
+    }
+
+    template <unsigned AMNT = MAXID + 1, typename Sink>
+    constexpr void backward(const std::array<double, AMNT>& input, const double adjoint, Sink& sink) const
+    {
+        const auto f = table->hermiteWithGradient(x.template eval<AMNT>(input), y.template eval<AMNT>(input));
+        x.template backward<AMNT>(input, adjoint * f[1], sink);
+        y.template backward<AMNT>(input, adjoint * f[2], sink);
+    }
+
+    using TypeName = Lookup2D<NX, NY, T1, T2>;
+    CONST_OPS(TypeName)
+    GENERIC_OPS(TypeName)
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//! Sink for backward(), collects derivatives w.r.t. DynamicVariable-s as (index, value) pairs.
+//! Capacity N is normally the DYNCOUNT of the expression, repeated indices are merged together.
+template <unsigned N>
+struct SparseGradient
+{
+    std::array<unsigned, N> indices{};
+    std::array<double, N> values{};
+    unsigned size = 0;
+
+    template <unsigned ID>
+    constexpr void variable([[maybe_unused]] const double value)
+    {
+    }
+
+    constexpr void parameter(const unsigned index, const double value)
+    {
+        for (unsigned i = 0; i < size; i++)
+        {
+            if (indices[i] == index)
+            {
+                values[i] += value;
+                return;
+            }
+        }
+        indices[size] = index;
+        values[size] = value;
+        size++;
+    }
+};
+
+//! Sink for backward(), accumulates derivatives w.r.t. DynamicVariable-s directly into a caller-owned buffer
+struct GradientScatter
+{
+    double* const buffer;
+
+    template <unsigned ID>
+    constexpr void variable([[maybe_unused]] const double value)
+    {
+    }
+
+    constexpr void parameter(const unsigned index, const double value) { buffer[index] += value; }
+};
+
+//! Sink for backward(), accumulates derivatives w.r.t. compile-time Variable<ID>-s into a dense array
+template <unsigned AMNT>
+struct DenseGradient
+{
+    std::array<double, AMNT> values{};
+
+    template <unsigned ID>
+    constexpr void variable(const double value)
+    {
+        values[ID] += value;
+    }
+
+    constexpr void parameter([[maybe_unused]] const unsigned index, [[maybe_unused]] const double value) {}
+};
+
+//! Sparse gradient of the expression w.r.t. all its DynamicVariable-s, optionally scaled
+template <typename T, std::size_t AMNT = T::MAXID + 1>
+[[nodiscard]] constexpr SparseGradient<T::DYNCOUNT> sparseGradient(const T& expr,
+                                                                   const std::array<double, AMNT>& input = {},
+                                                                   const double scale = 1.0)
+{
+    SparseGradient<T::DYNCOUNT> result{};
+    expr.template backward<AMNT>(input, scale, result);
+    return result;
+}
+
+//! Adds (scaled) gradient of the expression w.r.t. its DynamicVariable-s into buffer, buffer[index] += scale * df/dp
+template <typename T, std::size_t AMNT = T::MAXID + 1>
+constexpr void scatterGradient(const T& expr,
+                               const std::array<double, AMNT>& input,
+                               double* const buffer,
+                               const double scale = 1.0)
+{
+    GradientScatter sink{buffer};
+    expr.template backward<AMNT>(input, scale, sink);
+}
+
+//! Gradient w.r.t. all compile-time variables in a single reverse pass, same as calling gradient<ID>() for each ID
+template <typename T, std::size_t AMNT = T::MAXID + 1>
+[[nodiscard]] constexpr std::array<double, AMNT> denseGradient(const T& expr, const std::array<double, AMNT>& input)
+{
+    DenseGradient<AMNT> result{};
+    expr.template backward<AMNT>(input, 1.0, result);
+    return result.values;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//! Compensated (Kahan-Babuska-Neumaier) summation, keeps long reductions accurate
+struct KahanSum
+{
+    double sum = 0.0;
+    double compensation = 0.0;
+
+    constexpr void add(const double value)
+    {
+        const double t = sum + value;
+        const double absSum = sum < 0.0 ? -sum : sum;
+        const double absValue = value < 0.0 ? -value : value;
+        if (absSum >= absValue)
+        {
+            compensation += (sum - t) + value;
+        }
+        else
+        {
+            compensation += (value - t) + sum;
+        }
+        sum = t;
+    }
+
+    [[nodiscard]] constexpr double value() const { return sum + compensation; }
+};
+
+//! Robust losses for SumOfSquares, applied to squared residual s = r^2, return {rho(s), rho'(s)}
+//! Plain least squares, rho(s) = s
+struct TrivialLoss
+{
+    [[nodiscard]] constexpr std::array<double, 2> operator()(const double s) const { return {s, 1.0}; }
+};
+
+//! Huber loss, quadratic up to |r| = delta, linear afterwards
+struct HuberLoss
+{
+    const double delta;
+
+    [[nodiscard]] constexpr std::array<double, 2> operator()(const double s) const
+    {
+        if (s <= delta * delta)
+        {
+            return {s, 1.0};
+        }
+        const double r = std::sqrt(s);
+        return {2.0 * delta * r - delta * delta, delta / r};
+    }
+};
+
+//! Cauchy loss, rho(s) = c^2 * log(1 + s / c^2)
+struct CauchyLoss
+{
+    const double scale;
+
+    [[nodiscard]] constexpr std::array<double, 2> operator()(const double s) const
+    {
+        const double c2 = scale * scale;
+        return {c2 * std::log1p(s / c2), 1.0 / (1.0 + s / c2)};
+    }
+};
+
+//! Cost value and its gradient w.r.t. all compile-time variables
+template <unsigned AMNT>
+struct CostGradient
+{
+    double cost;
+    std::array<double, AMNT> gradient;
+};
+
+//! Cost value, gradient and Gauss-Newton approximation of the Hessian (J^T * J)
+template <unsigned AMNT>
+struct CostGaussNewton
+{
+    double cost;
+    std::array<double, AMNT> gradient;
+    std::array<std::array<double, AMNT>, AMNT> hessian;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//! Fused cost 0.5 * sum(rho(r_i^2)) over the list of residual expressions
+template <typename Loss, typename... Ts>
+struct SumOfSquares
+{
+    static constexpr unsigned MAXID = std::max({Ts::MAXID...});
+    static constexpr unsigned DYNCOUNT = (Ts::DYNCOUNT + ...);
+
+    explicit constexpr SumOfSquares(const Loss l, const Ts... r) : loss(l), residuals(r...) {}
+
+    AUTODF_NO_UNIQUE_ADDRESS const Loss loss;
+    AUTODF_NO_UNIQUE_ADDRESS const std::tuple<Ts...> residuals;
+
+    template <unsigned AMNT = MAXID + 1>
+    [[nodiscard]] constexpr double eval(const std::array<double, AMNT>& input = {}) const
+    {
+        KahanSum cost{};
+        std::apply(
+            [&](const auto&... r) {
+                (cost.add(loss(square(r.template eval<AMNT>(input)))[0]), ...);
+            },
+            residuals);
+        return 0.5 * cost.value();
+    }
+
+    template <unsigned forID, unsigned AMNT = MAXID + 1>
+    [[nodiscard]] constexpr double gradient(const std::array<double, AMNT>& input) const
+    {
+        KahanSum result{};
+        std::apply(
+            [&](const auto&... r) {
+                (result.add(weighted(r.template eval<AMNT>(input)) * r.template gradient<forID, AMNT>(input)), ...);
+            },
+            residuals);
+        return result.value();
+    }
+
+    template <unsigned AMNT = MAXID + 1, typename Sink>
+    constexpr void backward(const std::array<double, AMNT>& input, const double adjoint, Sink& sink) const
+    {
+        std::apply(
+            [&](const auto&... r) {
+                (r.template backward<AMNT>(input, adjoint * weighted(r.template eval<AMNT>(input)), sink), ...);
+            },
+            residuals);
+    }
+
+    //! Cost and gradient in one pass, every residual is evaluated once and differentiated by a single reverse sweep
+    template <unsigned AMNT = MAXID + 1>
+    [[nodiscard]] constexpr CostGradient<AMNT> evaluate(const std::array<double, AMNT>& input) const
+    {
+        KahanSum cost{};
+        std::array<KahanSum, AMNT> grad{};
+        std::apply(
+            [&](const auto&... r) {
+                (accumulate<AMNT, false>(r, input, cost, grad, nullptr), ...);
+            },
+            residuals);
+
+        CostGradient<AMNT> result{0.5 * cost.value(), {}};
+        for (unsigned i = 0; i < AMNT; i++)
+        {
+            result.gradient[i] = grad[i].value();
+        }
+        return result;
+    }
+
+    //! Same as evaluate(), additionally accumulates Gauss-Newton Hessian approximation sum(rho' * J_i^T * J_i)
+    template <unsigned AMNT = MAXID + 1>
+    [[nodiscard]] constexpr CostGaussNewton<AMNT> gaussNewton(const std::array<double, AMNT>& input) const
+    {
+        KahanSum cost{};
+        std::array<KahanSum, AMNT> grad{};
+        CostGaussNewton<AMNT> result{0.0, {}, {}};
+        std::apply(
+            [&](const auto&... r) {
+                (accumulate<AMNT, true>(r, input, cost, grad, &result.hessian), ...);
+            },
+            residuals);
+
+        result.cost = 0.5 * cost.value();
+        for (unsigned i = 0; i < AMNT; i++)
+        {
+            result.gradient[i] = grad[i].value();
+        }
+        return result;
+    }
+
+    using TypeName = SumOfSquares<Loss, Ts...>;
+    CONST_OPS(TypeName)
+    GENERIC_OPS(TypeName)
+
+  private:
+    [[nodiscard]] static constexpr double square(const double r) { return r * r; }
+
+    //! derivative of 0.5 * rho(r^2) w.r.t. r
+    [[nodiscard]] constexpr double weighted(const double r) const { return loss(r * r)[1] * r; }
+
+    template <unsigned AMNT, bool HESSIAN, typename T>
+    constexpr void accumulate(const T& residual,
+                              const std::array<double, AMNT>& input,
+                              KahanSum& cost,
+                              std::array<KahanSum, AMNT>& grad,
+                              std::array<std::array<double, AMNT>, AMNT>* hessian) const
+    {
+        const double r = residual.template eval<AMNT>(input);
+        const auto rho = loss(r * r);
+        cost.add(rho[0]);
+
+        DenseGradient<AMNT> jacobian{};
+        residual.template backward<AMNT>(input, 1.0, jacobian);
+        for (unsigned i = 0; i < AMNT; i++)
+        {
+            grad[i].add(rho[1] * r * jacobian.values[i]);
+        }
+        if constexpr (HESSIAN)
+        {
+            for (unsigned i = 0; i < AMNT; i++)
+            {
+                for (unsigned j = 0; j < AMNT; j++)
+                {
+                    (*hessian)[i][j] += rho[1] * jacobian.values[i] * jacobian.values[j];
+                }
+            }
+        }
+    }
+};
+
+template <typename... Ts>
+constexpr SumOfSquares<TrivialLoss, const Ts...> sumOfSquares(const Ts... residuals)
+{
+    return SumOfSquares<TrivialLoss, const Ts...>{TrivialLoss{}, residuals...};
+}
+
+template <typename Loss, typename... Ts>
+constexpr SumOfSquares<Loss, const Ts...> robustSumOfSquares(const Loss loss, const Ts... residuals)
+{
+    return SumOfSquares<Loss, const Ts...>{loss, residuals...};
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//! Outcome of iterative solvers (batched Newton, L-BFGS)
+enum class SolverStatus
+{
+    Converged,
+    MaxIterations,
+    Singular,
+    Diverged,
+    LineSearchFailed
+};
+
 }  // namespace autodf
 
 #endif  // AUTODF_H
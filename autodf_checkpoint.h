@@ -0,0 +1,298 @@
+/*
+ * This file is part of the AutoDf distribution (https://github.com/sergehog/autodf)
+ * Copyright (c) 2023-2024 Sergey Smirnov / Seregium Oy.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef AUTODF_CHECKPOINT_H
+#define AUTODF_CHECKPOINT_H
+
+#include "autodf.h"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace autodf
+{
+///////////////////////////////////////////////////////////////////////////////////////////////
+//! Outcome of checkpointed reverse sweep: memory spent vs. forward steps recomputed
+struct CheckpointReport
+{
+    unsigned steps;
+    //! checkpoint slots in use, memory budget clamped to steps - 1 (more slots than that are never needed)
+    unsigned checkpoints;
+    //! maximal number of checkpoints held at the same time
+    unsigned peakCheckpoints;
+    //! peakCheckpoints in bytes
+    std::size_t peakBytes;
+    //! all forward step evaluations, equals steps when every state fits into the budget; grows up to
+    //! steps^2 / 2 without checkpoints, so it is wider than steps
+    std::uint64_t forwardSteps;
+    std::uint64_t adjointSteps;
+    //! forwardSteps / steps
+    double recomputeRatio;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//! Gradient of loss(state_K) for time-stepped system state_{k+1} = f(state_k, params), where f is given by one
+//! expression per state element. Variable<0> ... Variable<S - 1> are the state, higher IDs are parameters; loss
+//! uses the same layout. Only a bounded number of states is stored, the rest is recomputed from checkpoints placed
+//! by binomial (Revolve) schedule, which minimizes recomputation for the given number of slots.
+template <typename L, typename... Ts>
+class CheckpointedReverse
+{
+  public:
+    static constexpr unsigned S = sizeof...(Ts);
+    static constexpr unsigned AMNT = std::max({S - 1, L::MAXID, Ts::MAXID...}) + 1;
+    static constexpr std::size_t STATE_BYTES = S * sizeof(double);
+
+    //! memoryBudget in bytes, every checkpoint costs STATE_BYTES
+    CheckpointedReverse(const std::size_t memoryBudget, const L l, const Ts... f)
+        : loss(l), stepFunction(f...), budget(memoryBudget / STATE_BYTES)
+    {
+    }
+
+    //! Loss after given amount of steps, starting from input (initial state and parameters),
+    //! gradient receives d loss / d input for both initial state and parameters
+    double gradient(const std::array<double, AMNT>& input,
+                    const unsigned steps,
+                    std::array<double, AMNT>& gradient,
+                    CheckpointReport* report = nullptr)
+    {
+        params = input;
+        gradient = {};
+        adjoint = {};
+        lossValue = 0.0;
+        totalSteps = steps;
+        used = 0;
+        peak = 0;
+        forwardSteps = 0;
+        adjointSteps = 0;
+
+        // storage grows only up to what this amount of steps can use, so huge budgets cost nothing extra
+        const auto checkpoints = static_cast<unsigned>(steps > 1 ? std::min<std::size_t>(budget, steps - 1) : 0);
+        if (slots.size() < checkpoints)
+        {
+            slots.resize(checkpoints);
+        }
+
+        State initial{};
+        for (unsigned i = 0; i < S; i++)
+        {
+            initial[i] = input[i];
+        }
+        if (steps == 0)
+        {
+            seed(initial, gradient);
+        }
+        else
+        {
+            reverse(0, steps, initial, checkpoints, gradient);
+        }
+        for (unsigned i = 0; i < S; i++)
+        {
+            gradient[i] = adjoint[i];
+        }
+
+        if (report != nullptr)
+        {
+            *report = {steps,
+                       checkpoints,
+                       peak,
+                       peak * STATE_BYTES,
+                       forwardSteps,
+                       adjointSteps,
+                       steps > 0 ? static_cast<double>(forwardSteps) / steps : 0.0};
+        }
+        return lossValue;
+    }
+
+  private:
+    using State = std::array<double, S>;
+
+    const L loss;
+    const std::tuple<Ts...> stepFunction;
+    //! checkpoint slots allowed by the memory budget
+    const std::size_t budget;
+    std::vector<State> slots;
+
+    std::array<double, AMNT> params{};
+    State adjoint{};
+    double lossValue = 0.0;
+    unsigned totalSteps = 0;
+    unsigned used = 0;
+    unsigned peak = 0;
+    std::uint64_t forwardSteps = 0;
+    std::uint64_t adjointSteps = 0;
+
+    //! binomial coefficient C(c + r, c), amount of steps reversible with c snapshots (held start state included)
+    //! and at most r forward evaluations of every step
+    [[nodiscard]] static double beta(const unsigned c, const unsigned r)
+    {
+        // C(c + r, c) == C(c + r, r), loop over the smaller one
+        const unsigned k = std::min(c, r);
+        const unsigned n = c + r;
+        double result = 1.0;
+        for (unsigned i = 1; i <= k; i++)
+        {
+            result = result * (n - k + i) / i;
+        }
+        return result;
+    }
+
+    //! reverses steps [a, b) having state at step a and c free checkpoint slots
+    void reverse(const unsigned a, const unsigned b, const State& state, const unsigned c, std::array<double, AMNT>& g)
+    {
+        const unsigned length = b - a;
+        if (length == 1)
+        {
+            adjointStep(a, state, g);
+            return;
+        }
+        if (c == 0)
+        {
+            for (unsigned k = b; k > a; k--)
+            {
+                State current = state;
+                advance(current, k - 1 - a);
+                adjointStep(k - 1, current, g);
+            }
+            return;
+        }
+        if (c >= length - 1)
+        {
+            // every intermediate state fits, store them in one forward sweep instead of recursing
+            const unsigned base = used;
+            State current = state;
+            for (unsigned k = 1; k < length; k++)
+            {
+                current = step(current);
+                slots[used++] = current;
+            }
+            peak = std::max(peak, used);
+            for (unsigned k = length - 1; k > 0; k--)
+            {
+                adjointStep(a + k, slots[base + k - 1], g);
+            }
+            used = base;
+            adjointStep(a, state, g);
+            return;
+        }
+
+        // state at a is held by the caller, so c free slots give c + 1 snapshots
+        unsigned r = 1;
+        while (beta(c + 1, r) < length)
+        {
+            r++;
+        }
+        // the right part gets one snapshot less and keeps r repetitions, the left part keeps all snapshots
+        // and needs one repetition less; this split reaches the minimal count r * length - beta(c + 2, r - 1)
+        const double lower = r >= 2 ? beta(c + 1, r - 2) : 0.0;
+        const auto split = static_cast<unsigned>(std::max(static_cast<double>(length) - beta(c, r), lower));
+
+        State& checkpoint = slots[used++];
+        peak = std::max(peak, used);
+        checkpoint = state;
+        advance(checkpoint, split);
+        reverse(a + split, b, checkpoint, c - 1, g);
+        used--;
+        reverse(a, a + split, state, c, g);
+    }
+
+    void advance(State& state, const unsigned count)
+    {
+        for (unsigned k = 0; k < count; k++)
+        {
+            state = step(state);
+        }
+    }
+
+    [[nodiscard]] State step(const State& state)
+    {
+        forwardSteps++;
+        const auto input = merge(state);
+        return std::apply([&](const auto&... f) { return State{f.template eval<AMNT>(input)...}; }, stepFunction);
+    }
+
+    [[nodiscard]] std::array<double, AMNT> merge(const State& state) const
+    {
+        auto input = params;
+        for (unsigned i = 0; i < S; i++)
+        {
+            input[i] = state[i];
+        }
+        return input;
+    }
+
+    //! loss at the final state initializes the adjoint
+    void seed(const State& finalState, std::array<double, AMNT>& g)
+    {
+        const auto input = merge(finalState);
+        lossValue = loss.template eval<AMNT>(input);
+        DenseGradient<AMNT> sink{};
+        loss.template backward<AMNT>(input, 1.0, sink);
+        for (unsigned i = 0; i < S; i++)
+        {
+            adjoint[i] = sink.values[i];
+        }
+        for (unsigned i = S; i < AMNT; i++)
+        {
+            g[i] += sink.values[i];
+        }
+    }
+
+    //! adjoint <- J_state(k)^T * adjoint, parameter gradient += J_params(k)^T * adjoint
+    void adjointStep(const unsigned k, const State& state, std::array<double, AMNT>& g)
+    {
+        if (k + 1 == totalSteps)
+        {
+            seed(step(state), g);
+        }
+        adjointSteps++;
+        const auto input = merge(state);
+        DenseGradient<AMNT> sink{};
+        backwardSteps(input, sink, std::make_index_sequence<S>{});
+        for (unsigned i = 0; i < S; i++)
+        {
+            adjoint[i] = sink.values[i];
+        }
+        for (unsigned i = S; i < AMNT; i++)
+        {
+            g[i] += sink.values[i];
+        }
+    }
+
+    template <std::size_t... I>
+    void backwardSteps(const std::array<double, AMNT>& input, DenseGradient<AMNT>& sink, std::index_sequence<I...>)
+    {
+        (std::get<I>(stepFunction).template backward<AMNT>(input, adjoint[I], sink), ...);
+    }
+};
+
+template <typename L, typename... Ts>
+CheckpointedReverse<const L, const Ts...> checkpointedReverse(const std::size_t memoryBudget,
+                                                              const L loss,
+                                                              const Ts... step)
+{
+    return CheckpointedReverse<const L, const Ts...>{memoryBudget, loss, step...};
+}
+
+}  // namespace autodf
+
+#endif  // AUTODF_CHECKPOINT_H
@@ -0,0 +1,428 @@
+/*
+ * This file is part of the AutoDf distribution (https://github.com/sergehog/autodf)
+ * Copyright (c) 2023-2024 Sergey Smirnov / Seregium Oy.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef AUTODF_LBFGS_H
+#define AUTODF_LBFGS_H
+
+#include "autodf.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace autodf
+{
+///////////////////////////////////////////////////////////////////////////////////////////////
+//! True for types providing the expression interface (MAXID, eval(), gradient<ID>()), false e.g. for functors
+template <typename T, typename = void>
+struct IsExpression : std::false_type
+{
+};
+
+template <typename T>
+struct IsExpression<T, std::void_t<decltype(T::MAXID)>> : std::true_type
+{
+};
+
+//! How LBFGS obtains gradients: gradient<ID>() for every variable, or single backward() sweep
+enum class GradientBackend
+{
+    Forward,
+    Reverse
+};
+
+struct LBFGSOptions
+{
+    unsigned maxIterations = 100;
+    //! converged when max |g_i| is below this value
+    double gradientTolerance = 1e-8;
+    //! converged when relative cost decrease is below this value
+    double functionTolerance = 1e-15;
+    //! strong Wolfe conditions, sufficient decrease (c1) and curvature (c2)
+    double c1 = 1e-4;
+    double c2 = 0.9;
+    unsigned maxLineSearch = 30;
+    GradientBackend backend = GradientBackend::Reverse;
+};
+
+//! Per-iteration statistics, evaluation counts include line search trials
+struct LBFGSIteration
+{
+    double cost;
+    double gradientNorm;
+    double step;
+    unsigned costEvaluations;
+    unsigned gradientEvaluations;
+    std::chrono::nanoseconds duration;
+};
+
+struct LBFGSSummary
+{
+    SolverStatus status;
+    unsigned iterations;
+    double cost;
+    unsigned costEvaluations;
+    unsigned gradientEvaluations;
+    std::chrono::nanoseconds duration;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//! Limited-memory BFGS minimizer of scalar expression over Variable<0> ... Variable<AMNT - 1>.
+//! Keeps the last M curvature pairs in a ring buffer and uses strong Wolfe line search.
+//! All working memory is allocated in constructor, minimize() does not touch the heap.
+template <typename T, unsigned AMNT = T::MAXID + 1, unsigned M = 8>
+class LBFGS
+{
+  public:
+    static_assert(M > 0, "LBFGS needs non-empty history");
+
+    explicit LBFGS(const T expr, const LBFGSOptions& o = {}) : cost(expr), options(o)
+    {
+        log.reserve(options.maxIterations);
+    }
+
+    //! Minimizes starting from x, result is written back to x
+    LBFGSSummary minimize(std::array<double, AMNT>& x)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        log.clear();
+        historySize = 0;
+        historyHead = 0;
+        costEvaluations = 0;
+        gradientEvaluations = 0;
+
+        double f = evaluate(x, g);
+        LBFGSSummary summary{SolverStatus::MaxIterations, 0, f, 0, 0, {}};
+        if (maxAbs(g) <= options.gradientTolerance)
+        {
+            summary.status = SolverStatus::Converged;
+        }
+
+        for (unsigned iteration = 0; iteration < options.maxIterations && summary.status != SolverStatus::Converged;
+             iteration++)
+        {
+            const auto iterationStart = std::chrono::steady_clock::now();
+            const unsigned costBefore = costEvaluations;
+            const unsigned gradientBefore = gradientEvaluations;
+
+            direction();
+            if (dot(d, g) >= 0.0)
+            {
+                // not a descent direction, history is dropped and steepest descent is used instead
+                historySize = 0;
+                for (unsigned i = 0; i < AMNT; i++)
+                {
+                    d[i] = -g[i];
+                }
+            }
+            const double initialStep = historySize == 0 ? std::min(1.0, 1.0 / maxAbs(g)) : 1.0;
+
+            double fNew = f;
+            const double step = lineSearch(x, f, initialStep, fNew);
+            if (step <= 0.0)
+            {
+                summary.status = SolverStatus::LineSearchFailed;
+                break;
+            }
+
+            // curvature pair s = x_new - x, y = g_new - g, skipped if it would break positive definiteness
+            auto& sNew = s[historyHead];
+            auto& yNew = y[historyHead];
+            for (unsigned i = 0; i < AMNT; i++)
+            {
+                sNew[i] = xTrial[i] - x[i];
+                yNew[i] = gTrial[i] - g[i];
+            }
+            const double sy = dot(sNew, yNew);
+            if (sy > std::numeric_limits<double>::epsilon() * dot(yNew, yNew))
+            {
+                rho[historyHead] = 1.0 / sy;
+                historyHead = (historyHead + 1) % M;
+                historySize = std::min(historySize + 1, M);
+            }
+
+            const double fOld = f;
+            x = xTrial;
+            g = gTrial;
+            f = fNew;
+            summary.iterations = iteration + 1;
+
+            const double gradientNorm = maxAbs(g);
+            log.push_back({f,
+                           gradientNorm,
+                           step,
+                           costEvaluations - costBefore,
+                           gradientEvaluations - gradientBefore,
+                           std::chrono::steady_clock::now() - iterationStart});
+
+            if (gradientNorm <= options.gradientTolerance ||
+                fOld - f <= options.functionTolerance * std::max({1.0, std::abs(f), std::abs(fOld)}))
+            {
+                summary.status = SolverStatus::Converged;
+            }
+        }
+
+        summary.cost = f;
+        summary.costEvaluations = costEvaluations;
+        summary.gradientEvaluations = gradientEvaluations;
+        summary.duration = std::chrono::steady_clock::now() - start;
+        return summary;
+    }
+
+    //! Statistics of every iteration of the last minimize() call
+    [[nodiscard]] const std::vector<LBFGSIteration>& iterations() const { return log; }
+
+  private:
+    const T cost;
+    const LBFGSOptions options;
+
+    std::array<std::array<double, AMNT>, M> s{};
+    std::array<std::array<double, AMNT>, M> y{};
+    std::array<double, M> rho{};
+    std::array<double, M> alpha{};
+    unsigned historySize = 0;
+    unsigned historyHead = 0;
+
+    std::array<double, AMNT> g{};
+    std::array<double, AMNT> d{};
+    std::array<double, AMNT> xTrial{};
+    std::array<double, AMNT> gTrial{};
+
+    unsigned costEvaluations = 0;
+    unsigned gradientEvaluations = 0;
+    std::vector<LBFGSIteration> log;
+
+    //! cost and gradient at x
+    double evaluate(const std::array<double, AMNT>& x, std::array<double, AMNT>& gradient)
+    {
+        costEvaluations++;
+        gradientEvaluations++;
+        if (options.backend == GradientBackend::Forward)
+        {
+            forward(x, gradient, std::make_index_sequence<AMNT>{});
+        }
+        else
+        {
+            DenseGradient<AMNT> sink{};
+            cost.template backward<AMNT>(x, 1.0, sink);
+            gradient = sink.values;
+        }
+        return cost.template eval<AMNT>(x);
+    }
+
+    template <std::size_t... I>
+    void forward(const std::array<double, AMNT>& x, std::array<double, AMNT>& gradient, std::index_sequence<I...>) const
+    {
+        ((gradient[I] = cost.template gradient<I, AMNT>(x)), ...);
+    }
+
+    //! two-loop recursion, d = -H * g
+    void direction()
+    {
+        for (unsigned i = 0; i < AMNT; i++)
+        {
+            d[i] = -g[i];
+        }
+        for (unsigned k = 0; k < historySize; k++)
+        {
+            const unsigned j = (historyHead + M - 1 - k) % M;
+            alpha[j] = rho[j] * dot(s[j], d);
+            for (unsigned i = 0; i < AMNT; i++)
+            {
+                d[i] -= alpha[j] * y[j][i];
+            }
+        }
+        if (historySize > 0)
+        {
+            const unsigned last = (historyHead + M - 1) % M;
+            const double gamma = 1.0 / (rho[last] * dot(y[last], y[last]));
+            for (unsigned i = 0; i < AMNT; i++)
+            {
+                d[i] *= gamma;
+            }
+        }
+        for (unsigned k = historySize; k > 0; k--)
+        {
+            const unsigned j = (historyHead + M - k) % M;
+            const double beta = rho[j] * dot(y[j], d);
+            for (unsigned i = 0; i < AMNT; i++)
+            {
+                d[i] += (alpha[j] - beta) * s[j][i];
+            }
+        }
+    }
+
+    //! cost phi(a) = f(x + a * d) and its slope, trial point is kept in xTrial / gTrial
+    double trial(const std::array<double, AMNT>& x, const double a, double& slope)
+    {
+        for (unsigned i = 0; i < AMNT; i++)
+        {
+            xTrial[i] = x[i] + a * d[i];
+        }
+        const double phi = evaluate(xTrial, gTrial);
+        slope = dot(gTrial, d);
+        return phi;
+    }
+
+    //! Strong Wolfe line search (Nocedal & Wright, Algorithm 3.5), returns accepted step or 0 on failure
+    double lineSearch(const std::array<double, AMNT>& x, const double f0, const double initialStep, double& fNew)
+    {
+        const double slope0 = dot(g, d);
+        double prevStep = 0.0;
+        double prevPhi = f0;
+        double prevSlope = slope0;
+        double step = initialStep;
+        for (unsigned i = 0; i < options.maxLineSearch; i++)
+        {
+            double slope = 0.0;
+            const double phi = trial(x, step, slope);
+            if (!std::isfinite(phi) || phi > f0 + options.c1 * step * slope0 || (i > 0 && phi >= prevPhi))
+            {
+                return zoom(x, f0, slope0, prevStep, prevPhi, prevSlope, step, phi, slope, fNew);
+            }
+            if (std::abs(slope) <= -options.c2 * slope0)
+            {
+                fNew = phi;
+                return step;
+            }
+            if (slope >= 0.0)
+            {
+                return zoom(x, f0, slope0, step, phi, slope, prevStep, prevPhi, prevSlope, fNew);
+            }
+            prevStep = step;
+            prevPhi = phi;
+            prevSlope = slope;
+            step *= 2.0;
+        }
+        return 0.0;
+    }
+
+    //! Zoom phase (Nocedal & Wright, Algorithm 3.6) with safeguarded cubic interpolation
+    double zoom(const std::array<double, AMNT>& x,
+                const double f0,
+                const double slope0,
+                double lo,
+                double phiLo,
+                double slopeLo,
+                double hi,
+                double phiHi,
+                double slopeHi,
+                double& fNew)
+    {
+        for (unsigned i = 0; i < options.maxLineSearch; i++)
+        {
+            const double step = interpolate(lo, phiLo, slopeLo, hi, phiHi, slopeHi);
+            double slope = 0.0;
+            const double phi = trial(x, step, slope);
+            if (!std::isfinite(phi) || phi > f0 + options.c1 * step * slope0 || phi >= phiLo)
+            {
+                hi = step;
+                phiHi = phi;
+                slopeHi = slope;
+            }
+            else
+            {
+                if (std::abs(slope) <= -options.c2 * slope0)
+                {
+                    fNew = phi;
+                    return step;
+                }
+                if (slope * (hi - lo) >= 0.0)
+                {
+                    hi = lo;
+                    phiHi = phiLo;
+                    slopeHi = slopeLo;
+                }
+                lo = step;
+                phiLo = phi;
+                slopeLo = slope;
+            }
+        }
+        // accept the best sufficient-decrease point even if curvature condition was not met
+        if (lo > 0.0)
+        {
+            double slope = 0.0;
+            fNew = trial(x, lo, slope);
+            return lo;
+        }
+        return 0.0;
+    }
+
+    //! minimizer of cubic through (a, phiA, slopeA), (b, phiB, slopeB), kept inside the interval
+    [[nodiscard]] static double interpolate(const double a,
+                                            const double phiA,
+                                            const double slopeA,
+                                            const double b,
+                                            const double phiB,
+                                            const double slopeB)
+    {
+        const double lower = std::min(a, b);
+        const double width = std::abs(b - a);
+        const double d1 = slopeA + slopeB - 3.0 * (phiA - phiB) / (a - b);
+        const double discriminant = d1 * d1 - slopeA * slopeB;
+        if (std::isfinite(phiB) && discriminant >= 0.0)
+        {
+            const double d2 = (b > a ? 1.0 : -1.0) * std::sqrt(discriminant);
+            const double step = b - (b - a) * (slopeB + d2 - d1) / (slopeB - slopeA + 2.0 * d2);
+            if (std::isfinite(step) && step >= lower + 0.1 * width && step <= lower + 0.9 * width)
+            {
+                return step;
+            }
+        }
+        return 0.5 * (a + b);
+    }
+
+    [[nodiscard]] static double dot(const std::array<double, AMNT>& a, const std::array<double, AMNT>& b)
+    {
+        return BlockMath::dot(a, b);
+    }
+
+    [[nodiscard]] static double maxAbs(const std::array<double, AMNT>& v)
+    {
+        double result = 0.0;
+        for (unsigned i = 0; i < AMNT; i++)
+        {
+            result = std::max(result, std::abs(v[i]));
+        }
+        return result;
+    }
+};
+
+//! LBFGS for an expression, or for a functor returning the expression to minimize
+template <unsigned M = 8, typename F>
+auto lbfgs(const F& source, const LBFGSOptions& options = {})
+{
+    if constexpr (IsExpression<F>::value)
+    {
+        return LBFGS<F, F::MAXID + 1, M>{source, options};
+    }
+    else
+    {
+        using T = decltype(source());
+        return LBFGS<T, T::MAXID + 1, M>{source(), options};
+    }
+}
+
+}  // namespace autodf
+
+#endif  // AUTODF_LBFGS_H
@@ -0,0 +1,297 @@
+/*
+ * This file is part of the AutoDf distribution (https://github.com/sergehog/autodf)
+ * Copyright (c) 2023-2024 Sergey Smirnov / Seregium Oy.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated
+ * documentation files (the "Software"), to deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+ * WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR
+ * OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef AUTODF_NEWTON_H
+#define AUTODF_NEWTON_H
+
+#include "autodf.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace autodf
+{
+///////////////////////////////////////////////////////////////////////////////////////////////
+//! Gaussian elimination with partial pivoting for small fixed-size systems A * x = b, all loops have
+//! compile-time bounds. Returns false (b is left partially modified) if the matrix is singular.
+struct SmallLinearSolver
+{
+    template <unsigned N>
+    [[nodiscard]] static constexpr bool solve(std::array<std::array<double, N>, N> a,
+                                              std::array<double, N>& b,
+                                              const double pivotTolerance = 1e-14)
+    {
+        for (unsigned k = 0; k < N; k++)
+        {
+            unsigned pivot = k;
+            double best = a[k][k] < 0.0 ? -a[k][k] : a[k][k];
+            for (unsigned i = k + 1; i < N; i++)
+            {
+                const double candidate = a[i][k] < 0.0 ? -a[i][k] : a[i][k];
+                if (candidate > best)
+                {
+                    best = candidate;
+                    pivot = i;
+                }
+            }
+            if (!(best > pivotTolerance))
+            {
+                return false;
+            }
+            if (pivot != k)
+            {
+                const auto row = a[k];
+                a[k] = a[pivot];
+                a[pivot] = row;
+                const double value = b[k];
+                b[k] = b[pivot];
+                b[pivot] = value;
+            }
+            for (unsigned i = k + 1; i < N; i++)
+            {
+                const double factor = a[i][k] / a[k][k];
+                for (unsigned j = k; j < N; j++)
+                {
+                    a[i][j] -= factor * a[k][j];
+                }
+                b[i] -= factor * b[k];
+            }
+        }
+        for (unsigned k = N; k > 0; k--)
+        {
+            const unsigned i = k - 1;
+            for (unsigned j = i + 1; j < N; j++)
+            {
+                b[i] -= a[i][j] * b[j];
+            }
+            b[i] /= a[i][i];
+        }
+        return true;
+    }
+};
+
+struct NewtonOptions
+{
+    unsigned maxIterations = 20;
+    //! converged when max |f_i| is below this value
+    double tolerance = 1e-10;
+    //! converged when max |dx_i| is below this value
+    double stepTolerance = 1e-14;
+    //! damped Newton, step is halved until sum f_i^2 decreases, system fails with LineSearchFailed
+    //! when it does not decrease after maxBacktracks halvings
+    bool damped = false;
+    unsigned maxBacktracks = 10;
+    //! worker threads, 0 means std::thread::hardware_concurrency()
+    unsigned threads = 0;
+};
+
+struct NewtonReport
+{
+    unsigned iterations;
+    SolverStatus status;
+    //! max |f_i| at the returned point, infinity if any residual is not finite
+    double residual;
+};
+
+///////////////////////////////////////////////////////////////////////////////////////////////
+//! Newton solver for a batch of small independent systems f(x) = 0 sharing the same residual expressions.
+//! Unknowns are Variable<0> ... Variable<N - 1> (N is the number of residuals), higher IDs are per-system data.
+//! Every system iterates on its own until it converges or fails, contiguous ranges of systems are spread over
+//! worker threads.
+template <typename... Ts>
+class BatchedNewton
+{
+  public:
+    static constexpr unsigned N = sizeof...(Ts);
+    static constexpr unsigned AMNT = std::max({N - 1, Ts::MAXID...}) + 1;
+
+    explicit BatchedNewton(const NewtonOptions& o, const Ts... r) : options(o), residuals(r...) {}
+
+    //! Solves count systems in-place, initial guess is taken from and solution is written to systems[i][0 .. N-1]
+    void solve(std::array<double, AMNT>* systems, NewtonReport* reports, const std::size_t count) const
+    {
+        const unsigned hardware = std::max(1U, std::thread::hardware_concurrency());
+        const std::size_t workers = std::min<std::size_t>(options.threads > 0 ? options.threads : hardware, count);
+        if (workers <= 1)
+        {
+            solveRange(systems, reports, 0, count);
+            return;
+        }
+
+        const std::size_t perWorker = (count + workers - 1) / workers;
+        std::vector<std::thread> pool;
+        pool.reserve(workers - 1);
+        for (std::size_t w = 1; w < workers; w++)
+        {
+            const std::size_t begin = std::min(count, w * perWorker);
+            const std::size_t end = std::min(count, (w + 1) * perWorker);
+            pool.emplace_back([this, systems, reports, begin, end]() { solveRange(systems, reports, begin, end); });
+        }
+        solveRange(systems, reports, 0, std::min(count, perWorker));
+        for (auto& worker : pool)
+        {
+            worker.join();
+        }
+    }
+
+  private:
+    const NewtonOptions options;
+    const std::tuple<Ts...> residuals;
+
+    void solveRange(std::array<double, AMNT>* systems,
+                    NewtonReport* reports,
+                    const std::size_t begin,
+                    const std::size_t end) const
+    {
+        for (std::size_t i = begin; i < end; i++)
+        {
+            reports[i] = solveSystem(systems[i]);
+        }
+    }
+
+    [[nodiscard]] NewtonReport solveSystem(std::array<double, AMNT>& x) const
+    {
+        auto f = evaluate(x);
+        NewtonReport report{0, SolverStatus::MaxIterations, maxAbs(f)};
+        if (report.residual <= options.tolerance)
+        {
+            report.status = SolverStatus::Converged;
+            return report;
+        }
+        for (unsigned iteration = 0; iteration < options.maxIterations; iteration++)
+        {
+            step(x, f, report);
+            if (report.status != SolverStatus::MaxIterations)
+            {
+                break;
+            }
+        }
+        return report;
+    }
+
+    //! one (damped) Newton step, updates status when the system converges or fails
+    void step(std::array<double, AMNT>& x, std::array<double, N>& f, NewtonReport& report) const
+    {
+        std::array<double, N> dx{};
+        for (unsigned i = 0; i < N; i++)
+        {
+            dx[i] = -f[i];
+        }
+        if (!SmallLinearSolver::solve<N>(jacobian(x, std::make_index_sequence<N>{}), dx))
+        {
+            report.status = SolverStatus::Singular;
+            return;
+        }
+
+        const double norm2 = dot(f);
+        double alpha = 1.0;
+        std::array<double, AMNT> candidate = x;
+        std::array<double, N> fc{};
+        for (unsigned backtrack = 0;; backtrack++)
+        {
+            for (unsigned i = 0; i < N; i++)
+            {
+                candidate[i] = x[i] + alpha * dx[i];
+            }
+            fc = evaluate(candidate);
+            if (!options.damped || dot(fc) < (1.0 - 1e-4 * alpha) * norm2)
+            {
+                break;
+            }
+            if (backtrack >= options.maxBacktracks)
+            {
+                // no sufficient decrease along Newton direction, keep the last accepted point
+                report.status = SolverStatus::LineSearchFailed;
+                return;
+            }
+            alpha *= 0.5;
+        }
+        x = candidate;
+        f = fc;
+        report.iterations++;
+        report.residual = maxAbs(f);
+        if (!std::isfinite(report.residual))
+        {
+            report.status = SolverStatus::Diverged;
+        }
+        else if (report.residual <= options.tolerance || (alpha == 1.0 && maxAbs(dx) <= options.stepTolerance))
+        {
+            // tiny step means convergence only when it is the full Newton step, not a cut-down one
+            report.status = SolverStatus::Converged;
+        }
+    }
+
+    [[nodiscard]] std::array<double, N> evaluate(const std::array<double, AMNT>& x) const
+    {
+        return std::apply([&](const auto&... r) { return std::array<double, N>{r.template eval<AMNT>(x)...}; },
+                          residuals);
+    }
+
+    //! Jacobian w.r.t. the unknowns, one reverse sweep per residual
+    template <std::size_t... I>
+    [[nodiscard]] std::array<std::array<double, N>, N> jacobian(const std::array<double, AMNT>& x,
+                                                                std::index_sequence<I...>) const
+    {
+        return {row(std::get<I>(residuals), x)...};
+    }
+
+    template <typename T>
+    [[nodiscard]] static std::array<double, N> row(const T& residual, const std::array<double, AMNT>& x)
+    {
+        DenseGradient<AMNT> gradient{};
+        residual.template backward<AMNT>(x, 1.0, gradient);
+        std::array<double, N> result{};
+        for (unsigned i = 0; i < N; i++)
+        {
+            result[i] = gradient.values[i];
+        }
+        return result;
+    }
+
+    [[nodiscard]] static double dot(const std::array<double, N>& v) { return BlockMath::dot(v, v); }
+
+    [[nodiscard]] static double maxAbs(const std::array<double, N>& v)
+    {
+        double result = 0.0;
+        for (unsigned i = 0; i < N; i++)
+        {
+            if (!std::isfinite(v[i]))
+            {
+                return std::numeric_limits<double>::infinity();
+            }
+            result = std::max(result, std::abs(v[i]));
+        }
+        return result;
+    }
+};
+
+template <typename... Ts>
+BatchedNewton<const Ts...> batchedNewton(const NewtonOptions& options, const Ts... residuals)
+{
+    return BatchedNewton<const Ts...>{options, residuals...};
+}
+
+}  // namespace autodf
+
+#endif  // AUTODF_NEWTON_H
@@ -17,6 +17,10 @@
  */
 
 #include "../autodf.h"
+#include "../autodf_checkpoint.h"
+#include "../autodf_lbfgs.h"
+#include "../autodf_newton.h"
+#include <vector>
 
 using namespace autodf;
 
@@ -193,6 +197,614 @@ constexpr int testGradient(const Variable<ID0> x, const Variable<ID1> y)
     return 0;
 }
 
+//! DynamicVariable and sparse gradient checks
+constexpr std::array<double, 4> kParams{1.0, 2.0, 3.0, 4.0};
+
+int testDynamicVariable()
+{
+    constexpr Variable<0> x;
+    constexpr DynamicVariable p1{kParams.data(), 1};
+    constexpr DynamicVariable p3{kParams.data(), 3};
+
+    static_assert(2.0 == p1.eval());
+    static_assert(0.0 == p1.gradient<0>({5.0}));
+    static_assert(2 == decltype(p1 * x + p3)::DYNCOUNT);
+    static_assert(11.0 == (p1 * x + p3).eval({3.5}));
+    // d/dp1 (p1 * x + p3 * p1) = x + p3, d/dp3 = p1
+    static_assert(2 == sparseGradient(p1 * x + p3 * p1, {0.5}).size);
+    static_assert(4.5 == sparseGradient(p1 * x + p3 * p1, {0.5}).values[0]);
+    static_assert(2.0 == sparseGradient(p1 * x + p3 * p1, {0.5}).values[1]);
+
+    // large parameter buffer, cost of a residual depends only on its own size
+    std::vector<double> params(5000);
+    for (std::size_t i = 0; i < params.size(); i++)
+    {
+        params[i] = 0.001 * static_cast<double>(i);
+    }
+    const DynamicVariable a{params.data(), 4321};
+    const DynamicVariable b{params.data(), 17};
+    const auto residual = sin(a) * x - b / a;
+    const std::array<double, 1> input{2.0};
+
+    const auto sparse = sparseGradient(residual, input);
+    if (sparse.size != 2 || sparse.indices[0] != 4321 || sparse.indices[1] != 17)
+    {
+        return 10;
+    }
+    const double va = params[4321];
+    const double vb = params[17];
+    if (std::abs(sparse.values[0] - (std::cos(va) * 2.0 + vb / (va * va))) > 1e-12 ||
+        std::abs(sparse.values[1] + 1.0 / va) > 1e-12)
+    {
+        return 11;
+    }
+
+    std::vector<double> grad(params.size(), 0.0);
+    scatterGradient(residual, input, grad.data(), 0.5);
+    scatterGradient(residual, input, grad.data(), 0.5);
+    if (std::abs(grad[4321] - sparse.values[0]) > 1e-12 || std::abs(grad[17] - sparse.values[1]) > 1e-12)
+    {
+        return 12;
+    }
+    return 0;
+}
+
+//! SumOfSquares and compensated summation checks
+template <unsigned ID0, unsigned ID1>
+int testSumOfSquares(const Variable<ID0> x, const Variable<ID1> y)
+{
+    constexpr auto cost = sumOfSquares(x - 3.0, 2.0 * y - x);
+    // 0.5 * ((1 - 3)^2 + (4 - 1)^2)
+    static_assert(6.5 == cost.eval({1.0, 2.0}));
+    // d/dx = (x - 3) - (2y - x) = -5, d/dy = 2 * (2y - x) = 6
+    static_assert(-5.0 == cost.template gradient<0>({1.0, 2.0}));
+    static_assert(6.0 == cost.template gradient<1>({1.0, 2.0}));
+    static_assert(-5.0 == cost.evaluate({1.0, 2.0}).gradient[0]);
+    static_assert(6.0 == cost.evaluate({1.0, 2.0}).gradient[1]);
+    static_assert(-5.0 == denseGradient(cost, std::array<double, 2>{1.0, 2.0})[0]);
+
+    constexpr auto gn = cost.gaussNewton({1.0, 2.0});
+    static_assert(6.5 == gn.cost);
+    static_assert(2.0 == gn.hessian[0][0]);
+    static_assert(-2.0 == gn.hessian[0][1]);
+    static_assert(-2.0 == gn.hessian[1][0]);
+    static_assert(4.0 == gn.hessian[1][1]);
+
+    // Huber keeps inliers quadratic, outliers get down-weighted gradient
+    constexpr auto huber = robustSumOfSquares(HuberLoss{1.0}, x - 3.0);
+    static_assert(0.125 == huber.eval({2.5}));
+    static_assert(-0.5 == huber.template gradient<0>({2.5}));
+    static_assert(-1.0 == huber.template gradient<0>({-7.0}));
+    static_assert(9.5 == huber.eval({-7.0}));
+
+    const auto cauchy = robustSumOfSquares(CauchyLoss{2.0}, x - 3.0);
+    if (std::abs(cauchy.eval({5.0}) - 2.0 * std::log(2.0)) > 1e-12 ||
+        std::abs(cauchy.template gradient<0>({5.0}) - 1.0) > 1e-12)
+    {
+        return 20;
+    }
+
+    // compensated summation does not lose small terms
+    constexpr auto compensated = []() {
+        KahanSum s{};
+        s.add(1e16);
+        s.add(1.0);
+        s.add(-1e16);
+        return s.value();
+    }();
+    static_assert(1.0 == compensated);
+
+    // cost over DynamicVariable-s scatters r * dr/dp into the parameter buffer
+    const std::array<double, 3> params{1.0, 2.0, 3.0};
+    const DynamicVariable p0{params.data(), 0};
+    const DynamicVariable p2{params.data(), 2};
+    std::array<double, 3> grad{};
+    scatterGradient(sumOfSquares(p0 * x - p2, p2 - 1.0), std::array<double, 1>{2.0}, grad.data());
+    // r0 = -1, r1 = 2: d/dp0 = r0 * x = -2, d/dp2 = -r0 + r1 = 3
+    if (grad[0] != -2.0 || grad[1] != 0.0 || grad[2] != 3.0)
+    {
+        return 21;
+    }
+    return 0;
+}
+
+//! Compares forward gradient<ID>(), reverse denseGradient() and central finite differences of a scalar expression
+template <typename T, std::size_t... IDs>
+bool gradientsAgree(const T& expr, const std::array<double, sizeof...(IDs)>& input, std::index_sequence<IDs...>)
+{
+    constexpr unsigned AMNT = sizeof...(IDs);
+    const std::array<double, AMNT> forward{expr.template gradient<IDs, AMNT>(input)...};
+    const auto reverse = denseGradient(expr, input);
+    for (unsigned i = 0; i < AMNT; i++)
+    {
+        auto plus = input;
+        auto minus = input;
+        plus[i] += 1e-6;
+        minus[i] -= 1e-6;
+        const double numeric = (expr.template eval<AMNT>(plus) - expr.template eval<AMNT>(minus)) / 2e-6;
+        if (std::abs(forward[i] - reverse[i]) > 1e-12 || std::abs(forward[i] - numeric) > 1e-6)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+//! Vector, matrix and quaternion block checks
+int testBlocks()
+{
+    constexpr Vec3Variable<0> a;
+    constexpr Vec3Variable<3> b;
+    constexpr Variable<6> angle;
+    constexpr QuatVariable<7> q;
+
+    static_assert(32.0 == dot(a, b).eval<6>({1.0, 2.0, 3.0, 4.0, 5.0, 6.0}));
+    static_assert(1.0 == dot(a, b).template gradient<3, 6>({1.0, 2.0, 3.0, 4.0, 5.0, 6.0}));
+    static_assert(5.0 == norm(a).eval({3.0, 4.0, 0.0}));
+    static_assert(0.6 == norm(a).gradient<0>({3.0, 4.0, 0.0}));
+    static_assert(-3.0 == component<2>(cross(a, b)).eval<6>({1.0, 2.0, 3.0, 4.0, 5.0, 6.0}));
+    static_assert(2.0 == component<0>(cross(a, b)).gradient<5, 6>({1.0, 2.0, 3.0, 4.0, 5.0, 6.0}));
+    static_assert(7.0 == component<1>(a * 2.0 + b - a).eval<6>({1.0, 2.0, 3.0, 4.0, 5.0, 6.0}));
+
+    const std::array<double, 11> input{0.3, -1.2, 0.7, 2.0, 0.5, -0.4, 0.9, 0.8, 0.2, -0.3, 0.4};
+    const auto seq = std::make_index_sequence<11>{};
+    if (!gradientsAgree(dot(a, b), input, seq) || !gradientsAgree(norm(cross(a, b)), input, seq) ||
+        !gradientsAgree(dot(b, matVec(rotation<0>(angle), a)), input, seq) ||
+        !gradientsAgree(dot(b, matVec(rotation<1>(angle * 2.0), a)), input, seq) ||
+        !gradientsAgree(norm(scale(angle, a) - b), input, seq) ||
+        !gradientsAgree(dot(b, rotate(q, a)), input, seq) ||
+        !gradientsAgree(component<3>(hamilton(q, q)) + dot(q, q), input, seq) ||
+        !gradientsAgree(component<1>(vec3(sin(angle), 3.0 * angle, 1.0 + angle)), input, seq))
+    {
+        return 30;
+    }
+
+    // quaternion (cos(t/2), 0, 0, sin(t/2)) rotates the same way as rotation matrix around Z
+    const double t = 0.9;
+    std::array<double, 11> qinput = input;
+    qinput[6] = t;
+    qinput[7] = std::cos(t / 2);
+    qinput[8] = 0.0;
+    qinput[9] = 0.0;
+    qinput[10] = std::sin(t / 2);
+    const auto rq = rotate(q, a).eval<11>(qinput);
+    const auto rm = matVec(rotation<2>(angle), a).eval<11>(qinput);
+    for (unsigned i = 0; i < 3; i++)
+    {
+        if (std::abs(rq[i] - rm[i]) > 1e-12)
+        {
+            return 31;
+        }
+    }
+    return 0;
+}
+
+//! Lookup-table tabulation checks, tables are built at compile time
+constexpr auto kCurve = tabulate<65>(asin(Variable<0>{} * 0.9), -1.0, 1.0);
+constexpr auto kSurface = tabulate<33, 33>(atan2(Variable<1>{}, Variable<0>{} + 3.0), {-1.0, -1.0}, {1.0, 1.0});
+
+int testTabulate()
+{
+    constexpr Variable<0> x;
+    constexpr Variable<1> y;
+    static_assert(kCurve.values[32] == 0.0);
+    static_assert(kCurve.hermite(0.0) == 0.0);
+    static_assert(kCurve.slopes[32] == 0.9);
+    static_assert(kCurve.linear(-5.0) == kCurve.values[0]);
+    static_assert(kCurve.at(x * 0.5).gradient<0>({0.0}) == 0.45);
+    // outside of [lo, hi] the lookup is clamped, so it is flat there
+    static_assert(kCurve.hermiteWithDerivative(1.5)[0] == kCurve.values[64]);
+    static_assert(kCurve.hermiteWithDerivative(1.5)[1] == 0.0);
+    static_assert(kCurve.at(x * 0.5).gradient<0>({-3.0}) == 0.0);
+    static_assert(kSurface.hermiteWithGradient(-2.0, 0.5)[1] == 0.0);
+    static_assert(kSurface.hermiteWithGradient(-2.0, 0.5)[2] != 0.0);
+
+    for (double v = -0.99; v < 1.0; v += 0.0137)
+    {
+        const double exact = std::asin(0.9 * v);
+        const double slope = 0.9 / std::sqrt(1.0 - 0.81 * v * v);
+        if (std::abs(kCurve.hermite(v) - exact) > 1e-5 || std::abs(kCurve.linear(v) - exact) > 1e-3 ||
+            std::abs(kCurve.hermiteWithDerivative(v)[1] - slope) > 1e-3)
+        {
+            return 40;
+        }
+    }
+
+    const auto lookup = kSurface.at(x, y * 2.0) + 1.0;
+    const std::array<double, 2> point{0.3, -0.21};
+    if (!gradientsAgree(lookup, point, std::make_index_sequence<2>{}))
+    {
+        return 41;
+    }
+    for (double u = -0.95; u < 1.0; u += 0.073)
+    {
+        for (double v = -0.95; v < 1.0; v += 0.081)
+        {
+            const double exact = std::atan2(v, u + 3.0);
+            if (std::abs(kSurface.hermite(u, v) - exact) > 1e-6 || std::abs(kSurface.linear(u, v) - exact) > 1e-3)
+            {
+                return 42;
+            }
+        }
+    }
+
+    // x is clamped at hi, y * 2.0 at lo: both partials vanish
+    const std::array<double, 2> outside{1.5, -0.7};
+    const auto reverse = denseGradient(lookup, outside);
+    if (lookup.gradient<0, 2>(outside) != 0.0 || lookup.gradient<1, 2>(outside) != 0.0 || reverse[0] != 0.0 ||
+        reverse[1] != 0.0)
+    {
+        return 43;
+    }
+    // only x is clamped, derivative w.r.t. y still flows
+    const std::array<double, 2> edge{-1.5, 0.2};
+    if (!gradientsAgree(lookup, edge, std::make_index_sequence<2>{}) || lookup.gradient<0, 2>(edge) != 0.0 ||
+        lookup.gradient<1, 2>(edge) == 0.0)
+    {
+        return 44;
+    }
+    return 0;
+}
+
+//! Polynomial node checks
+int testPolynomial()
+{
+    constexpr Variable<0> x;
+    constexpr BlockVariable<1, 4> c;
+    constexpr std::array<double, 8> coeffs{1.0, -2.0, 3.0, 0.5, -0.25, 0.125, 2.0, -1.0};
+
+    // 1 + 2 * x + 3 * x^2
+    static_assert(17.0 == polynomial(x, std::array<double, 3>{1.0, 2.0, 3.0}).eval({2.0}));
+    static_assert(14.0 == polynomial(x, std::array<double, 3>{1.0, 2.0, 3.0}).gradient<0>({2.0}));
+    static_assert(57.0 == polynomial(x * 2.0, std::array<double, 3>{1.0, 2.0, 3.0}).eval({2.0}));
+    static_assert(28.0 == polynomial(x * 2.0, std::array<double, 3>{1.0, 2.0, 3.0}).gradient<0>({1.0}));
+    static_assert(PolynomialMath::estrin(coeffs, 1.5) == PolynomialMath::horner(coeffs, 1.5));
+    static_assert(4.0 == PolynomialMath::hornerWithDerivative(std::array<double, 3>{1.0, 2.0, 1.0}, 1.0)[0]);
+    static_assert(4.0 == PolynomialMath::hornerWithDerivative(std::array<double, 3>{1.0, 2.0, 1.0}, 1.0)[1]);
+    // value and derivative w.r.t. argument 2 * x at once
+    static_assert(57.0 == polynomial(x * 2.0, std::array<double, 3>{1.0, 2.0, 3.0}).evalWithDerivative({2.0})[0]);
+    static_assert(26.0 == polynomial(x * 2.0, std::array<double, 3>{1.0, 2.0, 3.0}).evalWithDerivative({2.0})[1]);
+    // coefficients as variables, d/dc_k = x^k
+    static_assert(8.0 == polynomial(x, c).gradient<4>({2.0, 1.0, 1.0, 1.0, 1.0}));
+
+    const auto p = polynomial(sin(x), coeffs) + polynomial(x, c);
+    if (!gradientsAgree(p, {0.7, 0.5, -1.0, 0.25, 2.0}, std::make_index_sequence<5>{}))
+    {
+        return 50;
+    }
+
+    // 19 arguments cover two full lane chunks and a padded tail
+    std::array<double, 19> args{};
+    std::array<double, 19> batch{};
+    std::array<std::array<double, 1>, 19> scalars{};
+    std::array<std::array<double, 5>, 19> inputs{};
+    for (unsigned i = 0; i < args.size(); i++)
+    {
+        args[i] = -1.0 + 0.11 * i;
+        scalars[i] = {args[i]};
+        inputs[i] = {args[i], 0.5 - 0.1 * i, -1.0, 0.25 * i, 2.0};
+    }
+    PolynomialMath::estrinBatch(coeffs, args.data(), batch.data(), args.size());
+    for (unsigned i = 0; i < args.size(); i++)
+    {
+        double naive = 0.0;
+        for (unsigned k = 0; k < coeffs.size(); k++)
+        {
+            naive += coeffs[k] * std::pow(args[i], k);
+        }
+        if (std::abs(batch[i] - naive) > 1e-12)
+        {
+            return 51;
+        }
+    }
+
+    const auto fixed = polynomial(sin(x), coeffs);
+    fixed.evalBatch<1>(scalars.data(), batch.data(), scalars.size());
+    for (unsigned i = 0; i < args.size(); i++)
+    {
+        if (std::abs(batch[i] - fixed.eval<1>(scalars[i])) > 1e-12)
+        {
+            return 52;
+        }
+    }
+
+    const auto variable = polynomial(x, c);
+    variable.evalBatch<5>(inputs.data(), batch.data(), inputs.size());
+    for (unsigned i = 0; i < inputs.size(); i++)
+    {
+        if (std::abs(batch[i] - variable.eval<5>(inputs[i])) > 1e-12)
+        {
+            return 53;
+        }
+    }
+    return 0;
+}
+
+//! Batched Newton solver checks
+int testBatchedNewton()
+{
+    constexpr Variable<0> x;
+    constexpr Variable<1> y;
+    constexpr Variable<2> radius;
+    constexpr Variable<3> offset;
+
+    // intersection of circle x^2 + y^2 = radius^2 and line x - y = offset
+    NewtonOptions options{};
+    options.threads = 4;
+    const auto solver = batchedNewton(options, x * x + y * y - radius * radius, x - y - offset);
+    static_assert(4 == decltype(solver)::AMNT);
+
+    std::vector<std::array<double, 4>> systems(1001);
+    for (std::size_t i = 0; i < systems.size(); i++)
+    {
+        systems[i] = {1.0, 0.5, 1.0 + 0.001 * i, 0.1 + 0.0005 * i};
+    }
+    // the line misses the circle, no real solution
+    systems[500] = {1.0, 0.5, 1.0, 5.0};
+    // starts exactly at a singular Jacobian
+    systems[501] = {0.0, 0.0, 1.0, 0.0};
+
+    std::vector<NewtonReport> reports(systems.size());
+    solver.solve(systems.data(), reports.data(), systems.size());
+    for (std::size_t i = 0; i < systems.size(); i++)
+    {
+        if (i == 500 || i == 501)
+        {
+            continue;
+        }
+        const auto& s = systems[i];
+        if (reports[i].status != SolverStatus::Converged || reports[i].iterations == 0 ||
+            reports[i].iterations > 10 || std::abs(s[0] * s[0] + s[1] * s[1] - s[2] * s[2]) > 1e-9 ||
+            std::abs(s[0] - s[1] - s[3]) > 1e-9)
+        {
+            return 60;
+        }
+    }
+    if (reports[500].status == SolverStatus::Converged || reports[501].status != SolverStatus::Singular)
+    {
+        return 61;
+    }
+
+    // damped single-unknown system x^3 = a, started far away
+    NewtonOptions damped{};
+    damped.damped = true;
+    damped.maxIterations = 100;
+    damped.threads = 1;
+    const auto cubic = batchedNewton(damped, x * x * x - y);
+    std::array<std::array<double, 2>, 3> roots{{{10.0, 8.0}, {-3.0, 27.0}, {2.0, 8.0}}};
+    std::array<NewtonReport, 3> cubicReports{};
+    cubic.solve(roots.data(), cubicReports.data(), roots.size());
+    if (std::abs(roots[0][0] - 2.0) > 1e-9 || std::abs(roots[1][0] - 3.0) > 1e-9 || roots[2][0] != 2.0 ||
+        cubicReports[2].iterations != 0 || cubicReports[0].status != SolverStatus::Converged)
+    {
+        return 62;
+    }
+
+    // x^2 + 1 = 0 has no real root, damping must never accept a step that increases the residual
+    const auto noRoot = batchedNewton(damped, x * x + 1.0);
+    std::array<std::array<double, 1>, 1> start{{{0.3}}};
+    std::array<NewtonReport, 1> noRootReport{};
+    noRoot.solve(start.data(), noRootReport.data(), start.size());
+    if (noRootReport[0].status != SolverStatus::LineSearchFailed || noRootReport[0].residual > 0.3 * 0.3 + 1.0 ||
+        std::abs(start[0][0] * start[0][0] + 1.0 - noRootReport[0].residual) > 1e-15 || std::abs(start[0][0]) > 0.3)
+    {
+        return 63;
+    }
+    return 0;
+}
+
+//! Chained Rosenbrock function of N variables as sum of squares
+template <std::size_t... I>
+constexpr auto rosenbrock(std::index_sequence<I...>)
+{
+    return sumOfSquares((10.0 * (Variable<I + 1>{} - Variable<I>{} * Variable<I>{}))...,
+                        (1.0 - Variable<I>{})...);
+}
+
+//! L-BFGS minimizer checks
+int testLBFGS()
+{
+    const auto cost = rosenbrock(std::make_index_sequence<19>{});
+    for (const auto backend : {GradientBackend::Forward, GradientBackend::Reverse})
+    {
+        LBFGSOptions options{};
+        options.maxIterations = 500;
+        options.backend = backend;
+        auto minimizer = lbfgs(cost, options);
+
+        std::array<double, 20> x{};
+        x.fill(-1.2);
+        const auto summary = minimizer.minimize(x);
+        if (summary.status != SolverStatus::Converged || summary.iterations != minimizer.iterations().size() ||
+            summary.costEvaluations < summary.iterations || summary.cost > 1e-12)
+        {
+            return 70;
+        }
+        for (const double v : x)
+        {
+            if (std::abs(v - 1.0) > 1e-5)
+            {
+                return 71;
+            }
+        }
+    }
+
+    // functor producing an expression
+    auto quadratic = lbfgs<3>([]() {
+        constexpr Variable<0> x;
+        constexpr Variable<1> y;
+        return (x - 2.0) * (x - 2.0) + 10.0 * (y + 1.0) * (y + 1.0) + x * y;
+    });
+    std::array<double, 2> xy{0.0, 0.0};
+    const auto summary = quadratic.minimize(xy);
+    // minimum of x^2 - 4x + 10y^2 + 20y + xy: 2x - 4 + y = 0, 20y + 20 + x = 0
+    if (summary.status != SolverStatus::Converged || std::abs(xy[0] - 100.0 / 39.0) > 1e-6 ||
+        std::abs(xy[1] + 44.0 / 39.0) > 1e-6 || quadratic.iterations().empty())
+    {
+        return 72;
+    }
+    return 0;
+}
+
+#if defined(__cpp_nontype_template_args) && __cpp_nontype_template_args >= 201911L
+//! CConst checks, values live in types and expressions built from them carry no data
+template <unsigned ID0, unsigned ID1>
+constexpr int testCConst(const Variable<ID0> x, const Variable<ID1> y)
+{
+    constexpr auto two = cconst<2.0>;
+    static_assert(2.0 == two.eval());
+    static_assert(0.0 == two.template gradient<0>({1.0}));
+    static_assert(std::is_same_v<decltype(two * cconst<3.0> + cconst<1.0>), CConst<7.0>>);
+    static_assert(6.0 == (x * two).eval({3.0}));
+    static_assert(2.0 == (x * two).template gradient<0>({3.0}));
+    static_assert(13.0 == (x * two + y * cconst<3.0>).eval({2.0, 3.0}));
+    static_assert(3.0 == (x * two + y * cconst<3.0>).template gradient<1>({2.0, 3.0}));
+    static_assert(7.0 == sin(x * cconst<0.0>).eval({1.0}) + 7.0);
+
+    // empty nodes share address, runtime Const keeps its double
+    static_assert(1 == sizeof(x * two));
+    static_assert(1 == sizeof(x * two + y * cconst<3.0>));
+    static_assert(sizeof(double) == sizeof(x * Const{2.0}));
+    return 0;
+}
+#endif
+
+//! Minimal amount of forward steps for reversing given steps with c free checkpoint slots (start state is held
+//! separately): r * steps - C(c + r + 1, r - 1) with minimal r such that C(c + r + 1, r) >= steps, plus one step
+//! producing the final state for the loss
+std::size_t binomialForwardSteps(const unsigned steps, const unsigned c)
+{
+    const auto binomial = [](const std::size_t n, const std::size_t k) {
+        std::size_t result = 1;
+        for (std::size_t i = 1; i <= k; i++)
+        {
+            result = result * (n - k + i) / i;
+        }
+        return result;
+    };
+    std::size_t r = 1;
+    while (binomial(c + r + 1, r) < steps)
+    {
+        r++;
+    }
+    return r * steps - binomial(c + r + 1, r - 1) + 1;
+}
+
+//! Checkpointed reverse-mode checks on damped oscillator unrolled over many steps
+int testCheckpointedReverse()
+{
+    constexpr Variable<0> pos;
+    constexpr Variable<1> vel;
+    constexpr Variable<2> stiffness;
+    constexpr Variable<3> damping;
+    constexpr double dt = 0.01;
+
+    const auto loss = pos * pos + vel * vel;
+    const auto nextPos = pos + vel * dt;
+    const auto nextVel = vel - (stiffness * sin(pos) + damping * vel) * dt;
+    const std::array<double, 4> input{1.0, 0.0, 4.0, 0.3};
+    const unsigned steps = 1000;
+
+    // reference, every state fits into memory
+    auto full = checkpointedReverse(steps * 2 * sizeof(double), loss, nextPos, nextVel);
+    std::array<double, 4> reference{};
+    CheckpointReport fullReport{};
+    const double value = full.gradient(input, steps, reference, &fullReport);
+    if (fullReport.forwardSteps != steps || fullReport.adjointSteps != steps || fullReport.peakCheckpoints >= steps)
+    {
+        return 80;
+    }
+
+    // compare against finite differences of plain forward simulation
+    const auto simulate = [&](const std::array<double, 4>& in) {
+        std::array<double, 4> x = in;
+        for (unsigned k = 0; k < steps; k++)
+        {
+            const double p = nextPos.eval<4>(x);
+            x[1] = nextVel.eval<4>(x);
+            x[0] = p;
+        }
+        return loss.eval<4>(x);
+    };
+    if (std::abs(simulate(input) - value) > 1e-12)
+    {
+        return 81;
+    }
+    for (unsigned i = 0; i < 4; i++)
+    {
+        auto plus = input;
+        auto minus = input;
+        plus[i] += 1e-6;
+        minus[i] -= 1e-6;
+        if (std::abs((simulate(plus) - simulate(minus)) / 2e-6 - reference[i]) > 1e-6)
+        {
+            return 82;
+        }
+    }
+
+    // tighter budgets give the same gradient with more recomputation
+    double previousRatio = fullReport.recomputeRatio;
+    for (const unsigned checkpoints : {20U, 5U, 2U, 1U})
+    {
+        auto bounded = checkpointedReverse(checkpoints * 2 * sizeof(double), loss, nextPos, nextVel);
+        std::array<double, 4> g{};
+        CheckpointReport report{};
+        if (bounded.gradient(input, steps, g, &report) != value)
+        {
+            return 83;
+        }
+        for (unsigned i = 0; i < 4; i++)
+        {
+            if (std::abs(g[i] - reference[i]) > 1e-12 * std::max(1.0, std::abs(reference[i])))
+            {
+                return 84;
+            }
+        }
+        if (report.checkpoints != checkpoints || report.peakCheckpoints > checkpoints ||
+            report.peakBytes != report.peakCheckpoints * 2 * sizeof(double) || report.recomputeRatio <= previousRatio)
+        {
+            return 85;
+        }
+        // recomputation is the minimum reachable with this many slots
+        if (report.forwardSteps != binomialForwardSteps(steps, checkpoints))
+        {
+            return 89;
+        }
+        previousRatio = report.recomputeRatio;
+    }
+
+    // no checkpoints at all still works, recomputing from the initial state
+    auto none = checkpointedReverse(0, loss, nextPos, nextVel);
+    std::array<double, 4> g{};
+    CheckpointReport report{};
+    // closed form against exhaustive search over all schedules for 1000 steps
+    if (binomialForwardSteps(steps, 1) != 28821 || binomialForwardSteps(steps, 2) != 12156 ||
+        binomialForwardSteps(steps, 5) != 5285 || binomialForwardSteps(50, 0) != 49 * 50 / 2 + 1)
+    {
+        return 90;
+    }
+
+    none.gradient(input, 50, g, &report);
+    if (report.peakCheckpoints != 0 || report.forwardSteps != 49 * 50 / 2 + 1)
+    {
+        return 86;
+    }
+
+    // budget far above the amount of steps is clamped, slots are allocated on demand only
+    auto huge = checkpointedReverse(std::numeric_limits<std::size_t>::max(), loss, nextPos, nextVel);
+    if (huge.gradient(input, steps, g, &report) != value || g != reference || report.checkpoints != steps - 1 ||
+        report.forwardSteps != steps)
+    {
+        return 87;
+    }
+    huge.gradient(input, 200000, g, &report);
+    if (report.checkpoints != 200000 - 1 || report.peakCheckpoints != 200000 - 1 || report.forwardSteps != 200000)
+    {
+        return 88;
+    }
+    return 0;
+}
+
 int testRuntimeExpr()
 {
     constexpr autodf::Variable<0> c01;
@@ -272,10 +884,54 @@ int main()
     // tests gradient() function
     testGradient(x, y);
 
+#if defined(__cpp_nontype_template_args) && __cpp_nontype_template_args >= 201911L
+    testCConst(x, y);
+#endif
+
     if (const auto res = testSin(x) > 0)
     {
         return res;
     }
 
+    if (const auto res = testDynamicVariable(); res > 0)
+    {
+        return res;
+    }
+
+    if (const auto res = testSumOfSquares(x, y); res > 0)
+    {
+        return res;
+    }
+
+    if (const auto res = testBlocks(); res > 0)
+    {
+        return res;
+    }
+
+    if (const auto res = testTabulate(); res > 0)
+    {
+        return res;
+    }
+
+    if (const auto res = testPolynomial(); res > 0)
+    {
+        return res;
+    }
+
+    if (const auto res = testBatchedNewton(); res > 0)
+    {
+        return res;
+    }
+
+    if (const auto res = testLBFGS(); res > 0)
+    {
+        return res;
+    }
+
+    if (const auto res = testCheckpointedReverse(); res > 0)
+    {
+        return res;
+    }
+
     return testRuntimeExpr();
 }